@@ -0,0 +1,250 @@
+/*
+ * Copyright (c) 2013, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Microbenchmarks of the Kobuki update math with synthetic inputs.
+ */
+
+#include <cmath>
+#include <cstddef>
+#include <random>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include "kobuki_gazebo_plugins/diff_drive_model.h"
+#include "kobuki_gazebo_plugins/kobuki_model.h"
+#include "kobuki_gazebo_plugins/noise_model.h"
+
+using namespace gazebo;
+
+namespace
+{
+
+/// Synthetic robot states in the same layout as the fleet manager's batch
+struct SyntheticFleet
+{
+  explicit SyntheticFleet(std::size_t size)
+    : step(size, 0.001), wheel_vel_left(size), wheel_vel_right(size),
+      yaw_rate(size), x(size, 0.0), y(size, 0.0), yaw(size, 0.0), linear_vel(size), angular_vel(size)
+  {
+    std::mt19937 generator(42);
+    std::uniform_real_distribution<double> wheel_vel(-20.0, 20.0);
+    std::uniform_real_distribution<double> rate(-3.0, 3.0);
+    for (std::size_t i = 0; i < size; ++i)
+    {
+      wheel_vel_left[i] = wheel_vel(generator);
+      wheel_vel_right[i] = wheel_vel(generator);
+      yaw_rate[i] = rate(generator);
+    }
+  }
+
+  std::vector<double> step, wheel_vel_left, wheel_vel_right, yaw_rate;
+  std::vector<double> x, y, yaw, linear_vel, angular_vel;
+};
+
+/// Synthetic contacts: heights partly outside the bumper band, normals pointing in all directions
+struct SyntheticContacts
+{
+  explicit SyntheticContacts(std::size_t size) : height(size), normal_x(size), normal_y(size)
+  {
+    std::mt19937 generator(42);
+    std::uniform_real_distribution<double> z(-0.05, 0.2);
+    std::uniform_real_distribution<double> angle(-M_PI, M_PI);
+    for (std::size_t i = 0; i < size; ++i)
+    {
+      height[i] = z(generator);
+      double a = angle(generator);
+      normal_x[i] = std::cos(a);
+      normal_y[i] = std::sin(a);
+    }
+  }
+
+  std::vector<double> height, normal_x, normal_y;
+};
+
+std::vector<double> syntheticCliffRanges(std::size_t size)
+{
+  std::mt19937 generator(42);
+  std::uniform_real_distribution<double> range(0.0, 0.2);
+  std::vector<double> ranges(size);
+  for (std::size_t i = 0; i < size; ++i)
+  {
+    ranges[i] = range(generator);
+  }
+  return ranges;
+}
+
+} // namespace
+
+/*
+ * One odometry step for a fleet of robots, with the wheel geometry fixed at compile time or read at run time
+ */
+template <typename Geometry>
+static void BM_IntegrateOdometry(benchmark::State& state)
+{
+  const std::size_t robots = state.range(0);
+  SyntheticFleet fleet(robots);
+  // hide the run time geometry's values from the optimizer
+  Geometry geometry;
+  benchmark::DoNotOptimize(geometry);
+  const DiffDriveModel<Geometry> drive_model(geometry);
+  for (auto _ : state)
+  {
+    for (std::size_t i = 0; i < robots; ++i)
+    {
+      unsigned int nan_flags = drive_model.integrate(fleet.step[i], fleet.wheel_vel_left[i], fleet.wheel_vel_right[i],
+                                                     fleet.yaw_rate[i], fleet.x[i], fleet.y[i], fleet.yaw[i],
+                                                     fleet.linear_vel[i], fleet.angular_vel[i]);
+      benchmark::DoNotOptimize(nan_flags);
+    }
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * robots);
+}
+BENCHMARK_TEMPLATE(BM_IntegrateOdometry, KobukiWheelGeometry)->RangeMultiplier(4)->Range(1, 1024);
+BENCHMARK_TEMPLATE(BM_IntegrateOdometry, WheelGeometry)->RangeMultiplier(4)->Range(1, 1024);
+
+/*
+ * Height filtering and sector classification of one robot's contacts
+ */
+static void BM_ClassifyBumperContacts(benchmark::State& state)
+{
+  const std::size_t count = state.range(0);
+  SyntheticContacts contacts(count);
+  BumperSectors sectors;
+  for (auto _ : state)
+  {
+    sectors.setHeading(0.3);
+    unsigned int pressed = 0;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      if (isBumperContactHeight(contacts.height[i]))
+      {
+        pressed |= sectors.classify(contacts.normal_x[i], contacts.normal_y[i]);
+      }
+    }
+    benchmark::DoNotOptimize(pressed);
+  }
+  state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_ClassifyBumperContacts)->RangeMultiplier(4)->Range(1, 1024);
+
+/*
+ * Conversion of cliff sensor ranges to AD readings
+ */
+static void BM_CliffRangeToAD(benchmark::State& state)
+{
+  const std::size_t count = state.range(0);
+  std::vector<double> ranges = syntheticCliffRanges(count);
+  for (auto _ : state)
+  {
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      int bottom = cliffRangeToAD(ranges[i]);
+      benchmark::DoNotOptimize(bottom);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_CliffRangeToAD)->RangeMultiplier(4)->Range(1, 1024);
+
+static void BM_CliffADTable(benchmark::State& state)
+{
+  const std::size_t count = state.range(0);
+  std::vector<double> ranges = syntheticCliffRanges(count);
+  const CliffADTable& table = CliffADTable::instance();
+  for (auto _ : state)
+  {
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      int bottom = table(ranges[i]);
+      benchmark::DoNotOptimize(bottom);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_CliffADTable)->RangeMultiplier(4)->Range(1, 1024);
+
+/*
+ * Cliff detection for a fleet of robots
+ */
+static void BM_ClassifyCliffs(benchmark::State& state)
+{
+  const std::size_t robots = state.range(0);
+  std::vector<double> ranges = syntheticCliffRanges(robots * SENSOR_COUNT);
+  std::vector<unsigned int> cliffs(robots, 0);
+  for (auto _ : state)
+  {
+    for (std::size_t i = 0; i < robots; ++i)
+    {
+      cliffs[i] = classifyCliffs(&ranges[i * SENSOR_COUNT], cliffs[i], 0.04, 0.005);
+    }
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * robots);
+}
+BENCHMARK(BM_ClassifyCliffs)->RangeMultiplier(4)->Range(1, 1024);
+
+/*
+ * Encoder quantisation, wheel slip and gyro noise for a fleet of robots, drawing from the batched noise buffers
+ */
+static void BM_SensorNoise(benchmark::State& state)
+{
+  const std::size_t robots = state.range(0);
+  SyntheticFleet fleet(robots);
+  SensorNoiseParameters parameters;
+  parameters.encoder_quantisation = true;
+  parameters.wheel_slip_stddev = 0.02;
+  parameters.gyro_noise_stddev = 0.001;
+  parameters.gyro_drift_stddev = 0.0001;
+  std::vector<SensorNoiseModel> models(robots);
+  for (std::size_t i = 0; i < robots; ++i)
+  {
+    parameters.seed = i;
+    models[i].configure(parameters);
+  }
+  double position[2] = {0.0, 0.0};
+  for (auto _ : state)
+  {
+    for (std::size_t i = 0; i < robots; ++i)
+    {
+      double velocity[2] = {fleet.wheel_vel_left[i], fleet.wheel_vel_right[i]};
+      models[i].measureWheels(fleet.step[i], position, velocity);
+      double yaw_rate = models[i].measureYawRate(fleet.step[i], fleet.yaw_rate[i]);
+      models[i].replenish();
+      benchmark::DoNotOptimize(velocity);
+      benchmark::DoNotOptimize(yaw_rate);
+    }
+    position[0] += 0.01;
+    position[1] += 0.01;
+  }
+  state.SetItemsProcessed(state.iterations() * robots);
+}
+BENCHMARK(BM_SensorNoise)->RangeMultiplier(4)->Range(1, 1024);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2013, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Headless benchmark of a world with N Kobukis, reports the achieved physics steps per second and the resident
+ * memory each robot adds to the process.
+ *
+ * Usage: kobuki_world_benchmark <kobuki.sdf> [robots] [iterations] [world]
+ *
+ * The Kobuki model has to be given as SDF, e.g. converted from kobuki_description with
+ *   xacro kobuki_standalone.urdf.xacro > kobuki.urdf && gz sdf -p kobuki.urdf > kobuki.sdf
+ * The world defaults to Gazebo's empty world; pass kobuki_gazebo's worlds/empty.world to benchmark with
+ * its physics settings. A roscore needs to be running, since the plugins advertise their topics.
+ * The memory per robot includes the model's physics and sensors; run it once more with the plugin element
+ * removed from the model to tell the plugin's share apart (each plugin also logs its own memory on load).
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <gazebo/gazebo.hh>
+#include <gazebo/physics/physics.hh>
+#include <ros/ros.h>
+#include "kobuki_gazebo_plugins/gazebo_api.h"
+
+namespace
+{
+
+std::string readFile(const std::string& path)
+{
+  std::ifstream file(path.c_str());
+  std::stringstream content;
+  content << file.rdbuf();
+  return content.str();
+}
+
+/*
+ * Resident memory of the process [bytes]
+ */
+std::size_t residentMemory()
+{
+  std::ifstream statm("/proc/self/statm");
+  std::size_t size = 0;
+  std::size_t resident = 0;
+  statm >> size >> resident;
+  return resident * sysconf(_SC_PAGESIZE);
+}
+
+/*
+ * Give each robot its own name (also used as ROS namespace) and place the robots on a grid
+ */
+void insertKobuki(gazebo::physics::WorldPtr world, const std::string& model_sdf, unsigned int index)
+{
+  std::string name = "kobuki_" + std::to_string(index);
+  sdf::SDF sdf;
+  sdf.SetFromString(model_sdf);
+  sdf::ElementPtr model = sdf.Root()->GetElement("model");
+  model->GetAttribute("name")->Set(name);
+  model->GetElement("pose")->Set(ignition::math::Pose3d(1.0 * (index % 10), 1.0 * (index / 10), 0.0, 0.0, 0.0, 0.0));
+  sdf::ElementPtr plugin = model->HasElement("plugin") ? model->GetElement("plugin") : sdf::ElementPtr();
+  for (; plugin; plugin = plugin->GetNextElement("plugin"))
+  {
+    sdf::ElementPtr robot_namespace;
+    if (plugin->HasElement("robotNamespace"))
+    {
+      robot_namespace = plugin->GetElement("robotNamespace");
+    }
+    else
+    {
+      robot_namespace.reset(new sdf::Element);
+      robot_namespace->SetName("robotNamespace");
+      robot_namespace->AddValue("string", "", false);
+      plugin->InsertElement(robot_namespace);
+    }
+    robot_namespace->Set(name);
+  }
+  world->InsertModelSDF(sdf);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+  if (argc < 2)
+  {
+    std::cerr << "Usage: " << argv[0] << " <kobuki.sdf> [robots] [iterations] [world]" << std::endl;
+    return 1;
+  }
+  const std::string model_sdf = readFile(argv[1]);
+  const unsigned int robots = (argc > 2) ? std::atoi(argv[2]) : 10;
+  const unsigned int iterations = (argc > 3) ? std::atoi(argv[3]) : 10000;
+  const std::string world_file = (argc > 4) ? argv[4] : "worlds/empty.world";
+  if (model_sdf.empty())
+  {
+    std::cerr << "Couldn't read the model description from " << argv[1] << std::endl;
+    return 1;
+  }
+
+  // the Kobuki plugins refuse to load without an initialized ROS node
+  ros::init(argc, argv, "kobuki_world_benchmark", ros::init_options::NoSigintHandler);
+  if (!gazebo::setupServer(0, NULL))
+  {
+    std::cerr << "Couldn't set up the Gazebo server" << std::endl;
+    return 1;
+  }
+  gazebo::physics::WorldPtr world = gazebo::loadWorld(world_file);
+  if (!world)
+  {
+    std::cerr << "Couldn't load " << world_file << std::endl;
+    return 1;
+  }
+  // run as fast as possible
+  gazebo::api::physicsEngine(*world)->SetRealTimeUpdateRate(0.0);
+  const double step_size = gazebo::api::physicsEngine(*world)->GetMaxStepSize();
+
+  // the empty world's own allocations are done after its first updates
+  gazebo::runWorld(world, 100);
+  const std::size_t resident_before = residentMemory();
+  for (unsigned int i = 0; i < robots; ++i)
+  {
+    insertKobuki(world, model_sdf, i);
+  }
+  // models are inserted and their plugins loaded during the first updates, let them settle as well
+  gazebo::runWorld(world, 100);
+  const std::size_t resident_after = residentMemory();
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  gazebo::runWorld(world, iterations);
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  const unsigned int models = gazebo::api::modelCount(*world);
+  std::cout << "models: " << models << ", robots: " << robots << ", iterations: " << iterations << std::endl;
+  std::cout << "steps/s: " << iterations / elapsed
+            << ", real time factor: " << iterations * step_size / elapsed << std::endl;
+  if (robots > 0 && resident_after > resident_before)
+  {
+    std::cout << "resident memory per robot: " << (resident_after - resident_before) / robots / 1024 << " KiB"
+              << std::endl;
+  }
+
+  gazebo::shutdown();
+  return 0;
+}
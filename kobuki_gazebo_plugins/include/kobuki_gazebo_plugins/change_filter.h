@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2013, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Suppression of messages that don't differ from the last published one, independent of Gazebo and ROS.
+ */
+
+#ifndef KOBUKI_GAZEBO_PLUGINS_CHANGE_FILTER_H
+#define KOBUKI_GAZEBO_PLUGINS_CHANGE_FILTER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
+namespace gazebo
+{
+
+/**
+ * Lets a stream's values pass when any of them changed by more than its own minimum change since they last
+ * passed, or when the heartbeat period has gone by, so subscribers' timeouts don't fire while the values are
+ * steady. Each value has its own minimum change, as a stream's values come in different units.
+ * With all minimum changes zero or less, everything passes; otherwise a value with a minimum change of zero or
+ * less lets the values pass on any change of it.
+ */
+template <std::size_t N>
+class ChangeFilter
+{
+public:
+  ChangeFilter() : enabled_(false), heartbeat_period_(0.0)
+  {
+    for (std::size_t i = 0; i < N; ++i)
+    {
+      min_change_[i] = 0.0;
+    }
+    reset();
+  }
+
+  /**
+   * @param min_change change of each value that lets the values pass
+   * @param heartbeat_period time [s] after which the values pass even if unchanged, zero or less for never
+   */
+  void configure(const double (&min_change)[N], double heartbeat_period)
+  {
+    enabled_ = false;
+    for (std::size_t i = 0; i < N; ++i)
+    {
+      min_change_[i] = std::max(min_change[i], 0.0);
+      enabled_ = enabled_ || (min_change_[i] > 0.0);
+    }
+    heartbeat_period_ = heartbeat_period;
+    reset();
+  }
+  bool enabled() const { return enabled_; }
+
+  /// Let the next values pass in any case
+  void reset()
+  {
+    passed_time_ = std::numeric_limits<double>::quiet_NaN();
+  }
+
+  /**
+   * Whether the values at time now [s] pass, i.e. are to be published; remembers them if so
+   */
+  bool pass(const double (&values)[N], double now)
+  {
+    if (!enabled())
+    {
+      return true;
+    }
+    // always pass the first values and after time jumped back, e.g. on a world reset
+    bool due = !(now >= passed_time_) ||
+               ((heartbeat_period_ > 0.0) && (now - passed_time_ >= heartbeat_period_));
+    for (std::size_t i = 0; !due && (i < N); ++i)
+    {
+      due = !(std::fabs(values[i] - passed_[i]) <= min_change_[i]);
+    }
+    if (!due)
+    {
+      return false;
+    }
+    for (std::size_t i = 0; i < N; ++i)
+    {
+      passed_[i] = values[i];
+    }
+    passed_time_ = now;
+    return true;
+  }
+
+private:
+  bool enabled_;
+  double min_change_[N];
+  double heartbeat_period_;
+  double passed_[N];
+  double passed_time_;
+};
+
+} // namespace gazebo
+
+#endif /* KOBUKI_GAZEBO_PLUGINS_CHANGE_FILTER_H */
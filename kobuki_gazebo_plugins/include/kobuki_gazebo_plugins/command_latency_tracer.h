@@ -0,0 +1,165 @@
+/*
+ * Copyright (c) 2013, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Tracing of the latency between a velocity command's arrival and its effect, independent of Gazebo and ROS.
+ */
+
+#ifndef KOBUKI_GAZEBO_PLUGINS_COMMAND_LATENCY_TRACER_H
+#define KOBUKI_GAZEBO_PLUGINS_COMMAND_LATENCY_TRACER_H
+
+#include <algorithm>
+#include <chrono>
+#include <stdint.h>
+#include "kobuki_gazebo_plugins/stage_profiler.h"
+
+namespace gazebo
+{
+
+/**
+ * Tag of a velocity command, taken when it arrives
+ */
+struct CommandTrace
+{
+  /// Number of updates begun before the command arrived
+  uint64_t update;
+  /// Steady clock time of the arrival [ns]
+  uint64_t wall_nsec;
+};
+
+/**
+ * Follows the latest accepted velocity command through its milestones: applied (written to the joints) and
+ * seen in a published odometry message (the first one after it has acted on a physics step). For each milestone,
+ * the wall time and the number of updates since the arrival are collected over a window; a command superseded
+ * before reaching a milestone isn't counted for it.
+ */
+class CommandLatencyTracer
+{
+public:
+  enum Milestone { APPLIED, ODOMETRY, MILESTONE_COUNT };
+
+  struct Statistics
+  {
+    /// Wall time from the arrival [us]
+    StageProfiler::Statistics wall;
+    /// Updates from the arrival
+    double mean_updates;
+    uint64_t max_updates;
+  };
+
+  CommandLatencyTracer() : wall_(MILESTONE_COUNT), in_flight_(false), reached_(0), applied_update_(0)
+  {
+    reset();
+  }
+
+  static uint64_t now()
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  /// Tag a command arriving now, given the number of updates begun so far
+  static CommandTrace tag(uint64_t updates)
+  {
+    CommandTrace trace;
+    trace.update = updates;
+    trace.wall_nsec = now();
+    return trace;
+  }
+
+  /// A command is taken over by the current update, replacing the one in flight
+  void accept(const CommandTrace& trace)
+  {
+    trace_ = trace;
+    in_flight_ = true;
+    reached_ = 0;
+  }
+
+  /// The milestone happened on the given update; only counted once per command, odometry only after applying
+  void reach(Milestone milestone, uint64_t update)
+  {
+    if (!in_flight_ || (reached_ & (1u << milestone)))
+    {
+      return;
+    }
+    if ((milestone == ODOMETRY) && (!(reached_ & (1u << APPLIED)) || (update <= applied_update_)))
+    {
+      return;
+    }
+    if (milestone == APPLIED)
+    {
+      applied_update_ = update;
+    }
+    reached_ |= (1u << milestone);
+    wall_.add(milestone, now() - trace_.wall_nsec);
+    uint64_t updates = update - trace_.update;
+    update_sum_[milestone] += updates;
+    update_max_[milestone] = std::max(update_max_[milestone], updates);
+    in_flight_ = (reached_ != ((1u << MILESTONE_COUNT) - 1));
+  }
+
+  /// Statistics over the current window
+  Statistics statistics(Milestone milestone) const
+  {
+    Statistics statistics;
+    statistics.wall = wall_.statistics(milestone);
+    statistics.mean_updates = statistics.wall.count ?
+                              static_cast<double>(update_sum_[milestone]) / statistics.wall.count : 0.0;
+    statistics.max_updates = update_max_[milestone];
+    return statistics;
+  }
+
+  /// Heap memory held [bytes]
+  std::size_t memoryUsage() const { return wall_.memoryUsage(); }
+
+  /// Start a new window
+  void reset()
+  {
+    wall_.reset();
+    for (unsigned int i = 0; i < MILESTONE_COUNT; ++i)
+    {
+      update_sum_[i] = 0;
+      update_max_[i] = 0;
+    }
+  }
+
+private:
+  StageProfiler wall_;
+  uint64_t update_sum_[MILESTONE_COUNT];
+  uint64_t update_max_[MILESTONE_COUNT];
+  /// The command in flight, and the milestones it has reached (bit APPLIED etc.)
+  CommandTrace trace_;
+  bool in_flight_;
+  unsigned int reached_;
+  uint64_t applied_update_;
+};
+
+} // namespace gazebo
+
+#endif /* KOBUKI_GAZEBO_PLUGINS_COMMAND_LATENCY_TRACER_H */
@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2013, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Lock-free hand-over of commands from the ROS callback thread to Gazebo's update thread.
+ */
+
+#ifndef KOBUKI_GAZEBO_PLUGINS_COMMAND_SLOT_H
+#define KOBUKI_GAZEBO_PLUGINS_COMMAND_SLOT_H
+
+#include <atomic>
+
+namespace gazebo
+{
+
+/**
+ * Single-producer/single-consumer slot holding the latest written value (triple buffer).
+ * Neither side ever blocks. Values the consumer did not take in time are replaced by newer ones.
+ */
+template <typename T>
+class CommandSlot
+{
+public:
+  CommandSlot() : back_(0), front_(1), middle_(2) {}
+
+  /// Producer side: publish a new value
+  void write(const T& value)
+  {
+    buffers_[back_] = value;
+    back_ = middle_.exchange(back_ | DIRTY, std::memory_order_acq_rel) & INDEX_MASK;
+  }
+
+  /// Consumer side: fetch the latest value, returns false if nothing new has been written
+  bool read(T& value)
+  {
+    if ((middle_.load(std::memory_order_acquire) & DIRTY) == 0)
+      return false;
+    front_ = middle_.exchange(front_, std::memory_order_acq_rel) & INDEX_MASK;
+    value = buffers_[front_];
+    return true;
+  }
+
+private:
+  enum { INDEX_MASK = 3, DIRTY = 4 };
+
+  T buffers_[3];
+  /// Buffer owned by the producer
+  unsigned int back_;
+  /// Buffer owned by the consumer
+  unsigned int front_;
+  /// Buffer in between, tagged with DIRTY when it holds a value the consumer has not seen yet
+  std::atomic<unsigned int> middle_;
+};
+
+} // namespace gazebo
+
+#endif /* KOBUKI_GAZEBO_PLUGINS_COMMAND_SLOT_H */
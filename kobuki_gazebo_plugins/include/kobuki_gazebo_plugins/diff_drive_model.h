@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2013, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Differential drive kinematics and odometry of the Kobuki, independent of Gazebo and ROS.
+ */
+
+#ifndef KOBUKI_GAZEBO_PLUGINS_DIFF_DRIVE_MODEL_H
+#define KOBUKI_GAZEBO_PLUGINS_DIFF_DRIVE_MODEL_H
+
+#include <cmath>
+
+namespace gazebo
+{
+
+/// Flags returned by DiffDriveModel::integrate when a wheel reported a NaN velocity
+enum {ODOM_NAN_LEFT = 1, ODOM_NAN_RIGHT = 2};
+
+/**
+ * How DiffDriveModel::integrate advances the pose over one step
+ */
+enum OdometryIntegrator
+{
+  /// Move along the heading at the start of the step (error grows with the step size)
+  ODOM_INTEGRATOR_EULER,
+  /// Move along the heading in the middle of the step
+  ODOM_INTEGRATOR_MIDPOINT,
+  /// Move along the circular arc given by the step's distance and heading change (exact for constant velocities)
+  ODOM_INTEGRATOR_ARC
+};
+
+/**
+ * Wheel geometry of the stock Kobuki, known at compile time
+ */
+struct KobukiWheelGeometry
+{
+  static constexpr double separation() { return 0.230; }
+  static constexpr double radius() { return 0.035; }
+};
+
+/**
+ * Wheel geometry given at run time, e.g. through the model description
+ */
+class WheelGeometry
+{
+public:
+  WheelGeometry() : separation_(KobukiWheelGeometry::separation()), radius_(KobukiWheelGeometry::radius()) {}
+  WheelGeometry(double separation, double diameter) : separation_(separation), radius_(diameter / 2) {}
+
+  double separation() const { return separation_; }
+  double radius() const { return radius_; }
+
+private:
+  double separation_;
+  double radius_;
+};
+
+/**
+ * Kinematics of a differential drive with the given wheel geometry.
+ * Only stores the geometry, so it is cheap to copy and safe to share between threads.
+ */
+template <typename Geometry>
+class DiffDriveModel
+{
+public:
+  explicit DiffDriveModel(const Geometry& geometry = Geometry(),
+                          OdometryIntegrator integrator = ODOM_INTEGRATOR_EULER)
+    : geometry_(geometry), integrator_(integrator) {}
+
+  const Geometry& geometry() const { return geometry_; }
+
+  OdometryIntegrator integrator() const { return integrator_; }
+  void setIntegrator(OdometryIntegrator integrator) { integrator_ = integrator; }
+
+  /**
+   * Speeds of the wheel surfaces [m/s] for the commanded linear [m/s] and angular [rad/s] velocity
+   */
+  void wheelSpeeds(double linear_vel, double angular_vel, double& left, double& right) const
+  {
+    left = linear_vel - angular_vel * geometry_.separation() / 2;
+    right = linear_vel + angular_vel * geometry_.separation() / 2;
+  }
+
+  /**
+   * Joint velocity [rad/s] turning a wheel surface at the given speed [m/s]
+   */
+  double jointVelocity(double wheel_speed) const
+  {
+    return wheel_speed / geometry_.radius();
+  }
+
+  /**
+   * One odometry step. The travelled distance comes from the wheel joint velocities, while the heading
+   * is taken directly from the gyro, just as in the Kobuki driver. NaN wheel distances are zeroed.
+   * The higher order integrators keep the odometry (nearly) independent of the step size.
+   * @return bit mask of ODOM_NAN_LEFT/ODOM_NAN_RIGHT
+   */
+  unsigned int integrate(double step, double wheel_vel_left, double wheel_vel_right, double yaw_rate,
+                         double& x, double& y, double& yaw, double& linear_vel, double& angular_vel) const
+  {
+    unsigned int nan_flags = 0;
+    // Distance travelled by main wheels
+    double d1 = step * geometry_.radius() * wheel_vel_left;
+    double d2 = step * geometry_.radius() * wheel_vel_right;
+    // Can see NaN values here, just zero them out if needed
+    if (std::isnan(d1))
+    {
+      nan_flags |= ODOM_NAN_LEFT;
+      d1 = 0;
+    }
+    if (std::isnan(d2))
+    {
+      nan_flags |= ODOM_NAN_RIGHT;
+      d2 = 0;
+    }
+    double dr = (d1 + d2) / 2;
+    double dyaw = yaw_rate * step;
+
+    // Compute odometric pose
+    switch (integrator_)
+    {
+      case ODOM_INTEGRATOR_MIDPOINT:
+      {
+        x += dr * std::cos(yaw + dyaw / 2);
+        y += dr * std::sin(yaw + dyaw / 2);
+        break;
+      }
+      case ODOM_INTEGRATOR_ARC:
+      {
+        // chord of the arc, i.e. the midpoint step shortened by sin(h)/h; turns on the spot leave it at zero
+        double half = dyaw / 2;
+        double chord = (std::fabs(half) < 1e-6) ? dr : dr * std::sin(half) / half;
+        x += chord * std::cos(yaw + half);
+        y += chord * std::sin(yaw + half);
+        break;
+      }
+      default:
+      {
+        x += dr * std::cos(yaw);
+        y += dr * std::sin(yaw);
+        break;
+      }
+    }
+    yaw += dyaw;
+
+    // Compute odometric instantaneous velocity
+    linear_vel = dr / step;
+    angular_vel = yaw_rate;
+    return nan_flags;
+  }
+
+private:
+  Geometry geometry_;
+  OdometryIntegrator integrator_;
+};
+
+} // namespace gazebo
+
+#endif /* KOBUKI_GAZEBO_PLUGINS_DIFF_DRIVE_MODEL_H */
@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2013, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Coarse grid of the floor the cliff sensors have measured, independent of Gazebo and ROS.
+ */
+
+#ifndef KOBUKI_GAZEBO_PLUGINS_FLOOR_HEIGHT_CACHE_H
+#define KOBUKI_GAZEBO_PLUGINS_FLOOR_HEIGHT_CACHE_H
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+#include <stdint.h>
+
+namespace gazebo
+{
+
+/**
+ * Learns which cells of a 2D grid are flat floor from the cliff sensors' measurements. A cell becomes flat
+ * once enough measurements in it saw the floor within the tolerance of each other; a single measurement of a
+ * cliff or of a differing floor height marks it as an edge for good. Cells the sensors haven't seen are unknown.
+ * Only cells that have been visited are stored.
+ */
+class FloorHeightCache
+{
+public:
+  FloorHeightCache() : cell_size_(0.0), tolerance_(0.0), min_samples_(1), margin_(0) {}
+
+  /**
+   * @param cell_size edge length of the cells [m], zero or less disables the cache
+   * @param tolerance variation of the measured ranges [m] up to which a cell still counts as flat
+   * @param min_samples measurements after which a cell is known to be flat
+   * @param margin cells around a position that have to be flat as well before it counts as on flat floor
+   */
+  void configure(double cell_size, double tolerance, unsigned int min_samples, unsigned int margin)
+  {
+    cell_size_ = cell_size;
+    tolerance_ = tolerance;
+    // counted in a byte per cell
+    min_samples_ = std::min(std::max(min_samples, 1u), 255u);
+    margin_ = margin;
+    cells_.clear();
+  }
+  bool enabled() const { return cell_size_ > 0.0; }
+  std::size_t cellCount() const { return cells_.size(); }
+  /// Approximate heap memory held [bytes]: a node per cell plus the bucket array
+  std::size_t memoryUsage() const
+  {
+    return cells_.size() * (sizeof(std::pair<const uint64_t, Cell>) + sizeof(void*)) +
+           cells_.bucket_count() * sizeof(void*);
+  }
+
+  /**
+   * Add a measurement at the world position (x, y)
+   * @param range distance to the floor measured by the sensor [m]
+   * @param floor whether the range is clearly floor, i.e. far from the cliff detection threshold
+   */
+  void addSample(double x, double y, double range, bool floor)
+  {
+    Cell& cell = cells_[key(x, y)];
+    if (cell.state == EDGE)
+    {
+      return;
+    }
+    if (!floor)
+    {
+      cell.state = EDGE;
+      return;
+    }
+    float sample = static_cast<float>(range);
+    if (cell.samples == 0)
+    {
+      cell.range_min = sample;
+      cell.range_max = sample;
+    }
+    else
+    {
+      cell.range_min = std::min(cell.range_min, sample);
+      cell.range_max = std::max(cell.range_max, sample);
+    }
+    if ((cell.range_max - cell.range_min) > tolerance_)
+    {
+      cell.state = EDGE;
+      return;
+    }
+    if (cell.samples < min_samples_)
+    {
+      ++cell.samples;
+    }
+    if (cell.samples >= min_samples_)
+    {
+      cell.state = FLAT;
+    }
+  }
+
+  /// Whether the cell of (x, y) and all cells within the margin around it are known to be flat
+  bool flatAround(double x, double y) const
+  {
+    int64_t cx = index(x);
+    int64_t cy = index(y);
+    int64_t margin = margin_;
+    for (int64_t ix = cx - margin; ix <= cx + margin; ++ix)
+    {
+      for (int64_t iy = cy - margin; iy <= cy + margin; ++iy)
+      {
+        std::unordered_map<uint64_t, Cell>::const_iterator cell = cells_.find(key(ix, iy));
+        if ((cell == cells_.end()) || (cell->second.state != FLAT))
+        {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+private:
+  enum CellState { UNKNOWN, FLAT, EDGE };
+
+  struct Cell
+  {
+    Cell() : state(UNKNOWN), samples(0), range_min(0.0f), range_max(0.0f) {}
+    uint8_t state;
+    uint8_t samples;
+    float range_min;
+    float range_max;
+  };
+
+  int64_t index(double coordinate) const
+  {
+    return static_cast<int64_t>(std::floor(coordinate / cell_size_));
+  }
+  uint64_t key(double x, double y) const { return key(index(x), index(y)); }
+  static uint64_t key(int64_t ix, int64_t iy)
+  {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(ix)) << 32) | static_cast<uint32_t>(iy);
+  }
+
+  double cell_size_;
+  double tolerance_;
+  unsigned int min_samples_;
+  unsigned int margin_;
+  std::unordered_map<uint64_t, Cell> cells_;
+};
+
+} // namespace gazebo
+
+#endif /* KOBUKI_GAZEBO_PLUGINS_FLOOR_HEIGHT_CACHE_H */
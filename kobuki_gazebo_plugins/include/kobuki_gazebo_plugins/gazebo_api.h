@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2013, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * The parts of Gazebo's API the plugin uses that differ between Gazebo versions, so the rest of the plugin has
+ * a single code path. Gazebo 9 moved to the ignition math types and renamed most accessors.
+ */
+
+#ifndef KOBUKI_GAZEBO_PLUGINS_GAZEBO_API_H
+#define KOBUKI_GAZEBO_PLUGINS_GAZEBO_API_H
+
+#include <string>
+#include <gazebo/gazebo.hh>
+#include <gazebo/common/Time.hh>
+#if GAZEBO_MAJOR_VERSION >= 9
+  #include <ignition/math/Pose3.hh>
+  #include <ignition/math/Quaternion.hh>
+  #include <ignition/math/Vector3.hh>
+#else
+  #include <gazebo/math/gzmath.hh>
+#endif
+#include <gazebo/physics/physics.hh>
+#include <gazebo/sensors/sensors.hh>
+
+namespace gazebo
+{
+namespace api
+{
+
+/*
+ * The adapters are selected at compile time (by the Gazebo version, or by overloading on the math types) and
+ * inline to the plain member access. Poses are returned as references to Gazebo's own, so nothing is copied.
+ */
+#if GAZEBO_MAJOR_VERSION >= 9
+  typedef ignition::math::Vector3d Vector3;
+  typedef ignition::math::Quaterniond Quaternion;
+  typedef ignition::math::Pose3d Pose;
+
+  inline double x(const Vector3& v) { return v.X(); }
+  inline double y(const Vector3& v) { return v.Y(); }
+  inline double z(const Vector3& v) { return v.Z(); }
+  inline void setZ(Vector3& v, double z) { v.Z(z); }
+
+  inline double x(const Quaternion& q) { return q.X(); }
+  inline double y(const Quaternion& q) { return q.Y(); }
+  inline double z(const Quaternion& q) { return q.Z(); }
+  inline double w(const Quaternion& q) { return q.W(); }
+  inline double roll(const Quaternion& q) { return q.Roll(); }
+  inline double pitch(const Quaternion& q) { return q.Pitch(); }
+  inline double yaw(const Quaternion& q) { return q.Yaw(); }
+
+  inline const Vector3& position(const Pose& pose) { return pose.Pos(); }
+  inline const Quaternion& rotation(const Pose& pose) { return pose.Rot(); }
+
+  inline common::Time simTime(physics::World& world) { return world.SimTime(); }
+  inline physics::BasePtr entityByName(physics::World& world, const std::string& name)
+  {
+    return world.EntityByName(name);
+  }
+  inline physics::PhysicsEnginePtr physicsEngine(physics::World& world) { return world.Physics(); }
+  inline unsigned int modelCount(physics::World& world) { return world.ModelCount(); }
+  inline const Pose& worldPose(const physics::Model& model) { return model.WorldPose(); }
+  inline Pose worldPose(const physics::Link& link) { return link.WorldPose(); }
+  /// Pose relative to the sensor's link
+  inline Pose sensorPose(const sensors::Sensor& sensor) { return sensor.Pose(); }
+  inline double jointPosition(const physics::Joint& joint, unsigned int index) { return joint.Position(index); }
+  inline common::Time lastUpdateTime(const sensors::Sensor& sensor) { return sensor.LastUpdateTime(); }
+#else
+  typedef math::Vector3 Vector3;
+  typedef math::Quaternion Quaternion;
+  typedef math::Pose Pose;
+
+  inline double x(const Vector3& v) { return v.x; }
+  inline double y(const Vector3& v) { return v.y; }
+  inline double z(const Vector3& v) { return v.z; }
+  inline void setZ(Vector3& v, double z) { v.z = z; }
+
+  inline double x(const Quaternion& q) { return q.x; }
+  inline double y(const Quaternion& q) { return q.y; }
+  inline double z(const Quaternion& q) { return q.z; }
+  inline double w(const Quaternion& q) { return q.w; }
+  inline double roll(const Quaternion& q) { return q.GetRoll(); }
+  inline double pitch(const Quaternion& q) { return q.GetPitch(); }
+  inline double yaw(const Quaternion& q) { return q.GetYaw(); }
+
+  inline const Vector3& position(const Pose& pose) { return pose.pos; }
+  inline const Quaternion& rotation(const Pose& pose) { return pose.rot; }
+
+  inline common::Time simTime(physics::World& world) { return world.GetSimTime(); }
+  inline physics::BasePtr entityByName(physics::World& world, const std::string& name)
+  {
+    return world.GetEntity(name);
+  }
+  inline physics::PhysicsEnginePtr physicsEngine(physics::World& world) { return world.GetPhysicsEngine(); }
+  inline unsigned int modelCount(physics::World& world) { return world.GetModelCount(); }
+  inline Pose worldPose(const physics::Model& model) { return model.GetWorldPose(); }
+  inline Pose worldPose(const physics::Link& link) { return link.GetWorldPose(); }
+  inline Pose sensorPose(const sensors::Sensor& sensor) { return sensor.GetPose(); }
+  inline double jointPosition(const physics::Joint& joint, unsigned int index)
+  {
+    return joint.GetAngle(index).Radian();
+  }
+  inline common::Time lastUpdateTime(const sensors::Sensor& sensor) { return sensor.GetLastUpdateTime(); }
+#endif
+
+/**
+ * Copy a vector into a ROS message with x, y and z fields (e.g. geometry_msgs::Vector3 or Point)
+ */
+template <typename Message>
+inline void toMessage(const Vector3& v, Message& msg)
+{
+  msg.x = x(v);
+  msg.y = y(v);
+  msg.z = z(v);
+}
+
+/**
+ * Copy a quaternion into a ROS message with x, y, z and w fields (geometry_msgs::Quaternion)
+ */
+template <typename Message>
+inline void toMessage(const Quaternion& q, Message& msg)
+{
+  msg.x = x(q);
+  msg.y = y(q);
+  msg.z = z(q);
+  msg.w = w(q);
+}
+
+/// Copy a vector into an array of x, y and z
+inline void toArray(const Vector3& v, double array[3])
+{
+  array[0] = x(v);
+  array[1] = y(v);
+  array[2] = z(v);
+}
+
+/// Copy a quaternion into an array of x, y, z and w
+inline void toArray(const Quaternion& q, double array[4])
+{
+  array[0] = x(q);
+  array[1] = y(q);
+  array[2] = z(q);
+  array[3] = w(q);
+}
+
+} // namespace api
+} // namespace gazebo
+
+#endif /* KOBUKI_GAZEBO_PLUGINS_GAZEBO_API_H */
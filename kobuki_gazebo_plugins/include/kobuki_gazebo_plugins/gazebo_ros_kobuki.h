@@ -36,46 +36,81 @@
 #ifndef GAZEBO_ROS_KOBUKI_H
 #define GAZEBO_ROS_KOBUKI_H
 
+#include <atomic>
 #include <cmath>
 #include <cstring>
+#include <deque>
 #include <string>
 #include <boost/bind.hpp>
 #include <boost/thread.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/shared_ptr.hpp>
 #include <gazebo/gazebo.hh>
 #include <gazebo/common/common.hh>
 #include <gazebo/common/Time.hh>
-#if GAZEBO_MAJOR_VERSION >= 9
-  // #include <ignition/math.hh>
-  #include <ignition/math/Vector3.hh>
-  #include <ignition/math/Quaternion.hh>
-#else
-  #include <gazebo/math/gzmath.hh>
-#endif
 #include <gazebo/physics/physics.hh>
 #include <gazebo/sensors/sensors.hh>
 #include <gazebo_plugins/gazebo_ros_utils.h>
 #include <ros/ros.h>
+#include <ros/callback_queue.h>
 #include <std_msgs/Empty.h>
 #include <std_msgs/Float64.h>
 #include <sensor_msgs/Imu.h>
 #include <sensor_msgs/JointState.h>
 #include <nav_msgs/Odometry.h>
 #include <geometry_msgs/Twist.h>
+#include <geometry_msgs/TwistStamped.h>
 #include <geometry_msgs/TransformStamped.h>
 #include <tf/transform_broadcaster.h>
 #include <tf/LinearMath/Quaternion.h>
+#include <tf2_ros/transform_broadcaster.h>
 #include <kobuki_msgs/MotorPower.h>
 #include <kobuki_msgs/CliffEvent.h>
 #include <kobuki_msgs/BumperEvent.h>
+#include <kobuki_msgs/SensorState.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
+#include "kobuki_gazebo_plugins/CoreSim.h"
+#include "kobuki_gazebo_plugins/Telemetry.h"
+#include "kobuki_gazebo_plugins/StepN.h"
+#include "kobuki_gazebo_plugins/command_slot.h"
+#include "kobuki_gazebo_plugins/diff_drive_model.h"
+#include "kobuki_gazebo_plugins/gazebo_api.h"
+#include "kobuki_gazebo_plugins/kobuki_config.h"
+#include "kobuki_gazebo_plugins/kobuki_model.h"
+#include "kobuki_gazebo_plugins/message_pool.h"
+#include "kobuki_gazebo_plugins/noise_model.h"
+#include "kobuki_gazebo_plugins/publish_schedule.h"
+#include "kobuki_gazebo_plugins/ros_resources.h"
+#include "kobuki_gazebo_plugins/change_filter.h"
+#include "kobuki_gazebo_plugins/telemetry.h"
+#include "kobuki_gazebo_plugins/stage_profiler.h"
+#include "kobuki_gazebo_plugins/command_latency_tracer.h"
+#include "kobuki_gazebo_plugins/state_record_file.h"
+#include "kobuki_gazebo_plugins/shared_state_segment.h"
+#include "kobuki_gazebo_plugins/velocity_smoother.h"
+#include "kobuki_gazebo_plugins/world_stepper.h"
+#include "kobuki_gazebo_plugins/floor_height_cache.h"
 
 namespace gazebo
 {
 
 enum {LEFT= 0, RIGHT=1};
 
+/// Wheel speeds requested by a velocity command, handed from the ROS callbacks to the update loop
+struct WheelSpeedCommand
+{
+  double wheel_speed[2];
+  /// Arrival of the command, only tagged while latency tracing is enabled
+  CommandTrace trace;
+};
+
 class GazeboRosKobuki : public ModelPlugin
 {
+  // drives the update phases below for all robots of a world at once
+  friend class KobukiFleet;
+  // runs the step_n requests and collects their results
+  friend class WorldStepper;
+
 public:
   /// Constructor
   GazeboRosKobuki();
@@ -92,12 +127,16 @@ private:
    */
   /// Callback for incoming velocity commands
   void cmdVelCB(const geometry_msgs::TwistConstPtr &msg);
+  /// Callback for incoming velocity commands to be applied at the simulation time they are stamped with
+  void cmdVelStampedCB(const geometry_msgs::TwistStampedConstPtr &msg);
+  /// Callback for the step_n service, advancing the world in lockstep mode
+  bool stepCB(kobuki_gazebo_plugins::StepN::Request &req, kobuki_gazebo_plugins::StepN::Response &res);
   /// Callback for incoming velocity commands
   void motorPowerCB(const kobuki_msgs::MotorPowerPtr &msg);
   /// Callback for resetting the odometry data
   void resetOdomCB(const std_msgs::EmptyConstPtr &msg);
-  /// Spin method for the spinner thread
-  void spin();
+  /// Callback for (un)subscriptions to the sensor topics, used by the lazy sensor activation
+  void sensorSubscribersCB(const ros::SingleSubscriberPublisher &subscriber);
   //  void OnContact(const std::string &name, const physics::Contact &contact); necessary?
 
 
@@ -105,21 +144,76 @@ private:
   void prepareMotorPower();
   bool prepareJointState();
   void preparePublishTf();
-  bool prepareWheelAndTorque();
+  void preparePublishRates();
+  void preparePublishRate(const std::string& element_name, double rate, PublishSchedule& schedule);
+  void prepareWheelAndTorque();
   void prepareOdom();
-  bool prepareVelocityCommand();
+  void prepareVelocityCommand();
+  sensors::SensorPtr findSensor(const std::string& name, physics::LinkPtr* link = NULL) const;
   bool prepareCliffSensor();
   bool prepareBumper();
   bool prepareIMU();
+  void prepareTimingDiagnostics();
+  void prepareLatencyTracing();
+  void prepareLockstep();
+  void prepareCoreSim();
+  void prepareTelemetry();
+  void prepareRecorder();
+  void prepareSharedMemory();
+  void prepareNoise();
+  void prepareSensorActivation();
+  void prepareFloorCache();
   void setupRosApi(std::string& model_name);
+  void prepareMessages();
+  void prepareMessagePools();
+  std::size_t memoryUsage();
+  void reportMemoryUsage();
 
-  // internal functions for update
-  void updateJointState();
+  // internal functions for update, in the order they are called by OnUpdate (or by the KobukiFleet); from
+  // readSensors to fillMessages they only touch the robot's own data, so the KobukiFleet runs them on its worker
+  // threads, while Gazebo's sensors are switched, joints written, messages published and warnings logged by
+  // beginUpdate and publishMessages on the update thread
+  common::Time beginUpdate(const common::Time& time_now);
+  void readSharedCommand(const common::Time& time_now);
+  void queueStampedCommand(const geometry_msgs::TwistStamped& msg);
+  void applyStampedCommands(const common::Time& time_now);
+  void updateSensorActivation();
+  void readSensors(const common::Time& step_time);
+  void applySensorNoise(double step);
+  void updateFloorCache(unsigned int measured);
+  bool bumperChanged();
+  void readBumper();
+  unsigned int readBumperSensorContacts(double robot_height);
+  unsigned int readBumperPhysicsContacts(double robot_height);
+  double yawRate() const;
+  double wheelPosition(unsigned int side) const;
+  unsigned int bumperState() const;
+  void warnOdometryNaN(unsigned int nan_flags, const common::Time& step_time);
   void updateOdometry(common::Time& step_time);
+  void fillMessages(const common::Time& time_now);
+  void updateJointState();
+  void fillOdometry(nav_msgs::Odometry& odom) const;
+  void updateOdometryMessage();
+  bool fillTf();
+  void fillIMU(sensor_msgs::Imu& imu_msg) const;
   void updateIMU();
-  void propagateVelocityCommands();
+  void updateVelocitySmoother(const common::Time& time_now);
   void updateCliffSensor();
+  void fillSensorState(kobuki_msgs::SensorState& sensor_state) const;
+  void updateSensorState();
+  void updateCoreSim();
+  void updateTelemetry(const common::Time& time_now);
+  void fillStateRecord(const common::Time& time_now, KobukiStateRecord& record) const;
+  void recordState(const common::Time& time_now);
+  void writeSharedState(const common::Time& time_now);
+  void captureStepResult(const common::Time& time_now);
   void updateBumper();
+  void updateTimingDiagnostics();
+  void publishMessages();
+  void pauseCliffSensors();
+  void propagateVelocityCommands();
+  void setJointMotorForce(double force);
+  void moveKinematically();
 
 
   /*
@@ -132,25 +226,130 @@ private:
 
   /// TF Prefix
   std::string tf_prefix_;
-  /// extra thread for triggering ROS callbacks
-//  boost::shared_ptr<boost::thread> ros_spinner_thread_; necessary?
-  /// flag for shutting down the spinner thread
-  bool shutdown_requested_;
+  /// Resolved TF frame names, looked up once in setupRosApi
+  std::string base_link_frame_;
+  std::string odom_frame_;
+  std::string base_frame_;
+  /// Callback queue (served by its own spinner thread) and tf broadcasters, this instance's own or shared by all
+  /// instances of the process
+  boost::shared_ptr<RosResources> ros_resources_;
   /// pointer to the model
   physics::ModelPtr model_;
   /// pointer to the gazebo ros node
   GazeboRosPtr gazebo_ros_;
-  sdf::ElementPtr sdf_;
+  /// Parameters read from the model description, only held while loading
+  boost::scoped_ptr<KobukiConfig> config_;
   /// pointer to simulated world
   physics::WorldPtr world_;
   /// pointer to the update event connection (triggers the OnUpdate callback when event update event is received)
   event::ConnectionPtr update_connection_;
-  /// Simulation time on previous update
-  common::Time prev_update_time_;
+  /// State the updates read and write on every step, kept together in a few cache lines instead of spread between
+  /// the handles, messages and load-time parameters below
+  struct UpdateState
+  {
+    /// Simulation time on previous update
+    common::Time prev_update_time;
+    /// Simulation time of the last velocity command (used for time out)
+    common::Time last_cmd_vel_time;
+    /// Time of the cliff sensors' measurements held in cliff_range
+    common::Time cliff_update_time[SENSOR_COUNT];
+    /// Time of the bumper sensor's contacts the bumper state was last read from
+    common::Time bumper_update_time;
+    /// Time stamp shared by all messages published during the current update: the simulation time of the update
+    ros::Time update_stamp;
+    /// Length of the current update's step in seconds
+    double update_step;
+    /// Time out for velocity commands in seconds
+    double cmd_vel_timeout;
+    /// Speeds of the wheels
+    double wheel_speed_cmd[2];
+    /// Wheel joint velocities measured on the current update
+    double wheel_vel[2];
+    /// True wheel joint velocities on the current update (wheel_vel without the sensor noise)
+    double joint_vel[2];
+    /// Max. force currently set on the joint motors (zero while the motors are disabled)
+    double joint_motor_force;
+    /// Wheel positions [rad] integrated from the smoothed wheel speeds in the kinematic mode
+    double kinematic_wheel_position[2];
+    /// Vector for pose
+    double odom_pose[3];
+    /// Vector for velocity
+    double odom_vel[3];
+    /// Odometry pose and simulation time [s] of the transform sent last
+    double tf_sent_pose[3];
+    double tf_sent_time;
+    /// Distances to the floor measured by the left, center and right cliff sensors on the current update
+    double cliff_range[SENSOR_COUNT];
+    /// Storage for the angular velocity reported by the IMU
+    api::Vector3 vel_angular;
+    /// measured distance in meter for detecting a cliff
+    float cliff_detection_threshold;
+    /// distance in meter a sensor has to come back below the threshold before it measures the floor again
+    float cliff_detection_hysteresis;
+    /// Bit mask of the cliff sensors currently measuring a cliff (bit SENSOR_LEFT etc.)
+    unsigned int cliff_state;
+    /// Bit mask of the cliff sensors last reported as measuring a cliff through a cliff event
+    unsigned int cliff_detected;
+    /// Bit mask of the bumpers last reported as pressed through a bumper event
+    unsigned int bumper_was_pressed;
+    /// Bit mask of the bumpers pressed on the current update (bit SENSOR_LEFT etc.)
+    unsigned int bumper_is_pressed;
+    /// Messages fillMessages has filled on the current update for publishMessages (bit OUT_JOINT_STATE etc.)
+    unsigned int outbox;
+    /// Sensors (bit SENSOR_LEFT etc.) whose cliff and bumper events were filled on the current update
+    unsigned int cliff_events_out;
+    unsigned int bumper_events_out;
+    /// Flag indicating that the KobukiFleet updates this robot instead of update_connection_
+    bool fleet_managed;
+    /// Lockstep mode: the world is paused and advanced by the step_n service, commands are applied at their stamp
+    bool lockstep;
+    /// Whether the smoothed speeds changed on the current update, i.e. have to be written to the joints
+    bool wheel_speeds_changed;
+    /// Drive the wheels through the physics engine's joint motors (fmax/vel) instead of forcing their velocity
+    bool joint_motors;
+    /// Kinematic mode: the wheels aren't driven, the model is moved along the path of the smoothed wheel speeds
+    bool kinematic;
+    /// Flag for (not) publish tf transform for odom -> robot
+    bool publish_tf;
+    /// The KobukiFleet sends our transform together with all others' (tf_schedule_ isn't used then)
+    bool tf_batched;
+    /// Skip reading the cliff sensors and the bumper sensor's contacts while the sensors haven't updated
+    bool skip_unchanged_sensors;
+    /// Only run the cliff and bumper sensors while their readings are used, e.g. subscribed to
+    bool lazy_sensor_activation;
+    /// Whether the cliff sensors and the bumper sensor are currently active (always with eager activation)
+    bool cliff_sensors_active;
+    bool bumper_active;
+    /// Whether the floor cache has paused the (active) cliff sensors; cliff_range keeps their last floor ranges
+    bool cliff_sensors_paused;
+    /// Whether the floor cache wants the cliff sensors paused, applied to them by publishMessages
+    bool cliff_sensors_pausing;
+    /// Take the bumper's contacts straight from the physics engine instead of copying the sensor's contacts
+    bool bumper_physics_contacts;
+    /// Whether the raw cliff and bumper readings, the combined robot state and the decimated telemetry are
+    /// published (each disabled unless its rate is given)
+    bool publish_sensor_state;
+    bool publish_core_sim;
+    bool publish_telemetry;
+  };
+  UpdateState state_;
+  /// Number of updates begun so far, read by the spinner thread to tag commands for the latency tracing
+  std::atomic<uint64_t> update_count_;
+  /// Publishing schedules of the joint state, odometry, IMU and tf streams
+  PublishSchedule joint_state_schedule_;
+  PublishSchedule odom_schedule_;
+  PublishSchedule imu_schedule_;
+  PublishSchedule tf_schedule_;
+  /// Suppress joint state, odometry and IMU messages that hardly differ from the last published ones
+  ChangeFilter<4> joint_state_filter_;
+  ChangeFilter<5> odom_filter_;
+  ChangeFilter<9> imu_filter_;
+  /// Period [s] after which unchanged streams (and the transform) are published anyway, zero for never
+  double heartbeat_period_;
   /// ROS subscriber for motor power commands
   ros::Subscriber motor_power_sub_;
   /// Flag indicating if the motors are turned on or not
-  bool motors_enabled_;
+  std::atomic<bool> motors_enabled_;
   /// Pointers to Gazebo's joints
   physics::JointPtr joints_[2];
   /// Left wheel's joint name
@@ -161,92 +360,165 @@ private:
   ros::Publisher joint_state_pub_;
   /// ROS message for joint sates
   sensor_msgs::JointState joint_state_;
+  /// Preallocated joint state messages for intra-process publishing (unused if disabled)
+  MessagePool<sensor_msgs::JointState> joint_state_pool_;
   /// ROS subscriber for velocity commands
   ros::Subscriber cmd_vel_sub_;
-  /// Simulation time of the last velocity command (used for time out)
-  common::Time last_cmd_vel_time_;
-  /// Time out for velocity commands in seconds
-  double cmd_vel_timeout_;
-  /// Speeds of the wheels
-  double wheel_speed_cmd_[2];
+  /// Latest velocity command, written by the spinner thread and taken over in OnUpdate
+  CommandSlot<WheelSpeedCommand> cmd_vel_slot_;
+  /// ROS subscriber and service of the lockstep mode, the service is served on the step queue through step_nh_
+  ros::Subscriber cmd_vel_stamped_sub_;
+  boost::scoped_ptr<ros::NodeHandle> step_nh_;
+  ros::ServiceServer step_service_;
+  struct StampedWheelSpeedCommand
+  {
+    common::Time stamp;
+    WheelSpeedCommand command;
+  };
+  /// Stamped velocity commands ordered by their stamp (ties keep their arrival order), guarded by stamped_cmd_mutex_
+  std::deque<StampedWheelSpeedCommand> stamped_cmds_;
+  boost::mutex stamped_cmd_mutex_;
+  /// Updates left until the running step_n request is done (the result is captured on the last one), set by the
+  /// WorldStepper
+  std::atomic<unsigned int> step_updates_remaining_;
+  /// State after the last step of the running step_n request, guarded by step_mutex_ (null unless in lockstep
+  /// mode)
+  boost::scoped_ptr<kobuki_gazebo_plugins::StepN::Response> step_result_;
+  boost::mutex step_mutex_;
+  /// Ramps the wheel speeds towards state_.wheel_speed_cmd within the acceleration limits
+  VelocitySmoother velocity_smoother_;
+  /// Joint velocity error [rad/s] up to which the joints aren't written while the smoothed speeds don't change
+  double joint_velocity_tolerance_;
+  /// Joint velocity writes since the timing diagnostics were last published
+  unsigned long joint_writes_;
   /// Max. torque applied to the wheels
   double torque_;
   /// Separation between the wheels
   double wheel_sep_;
   /// Diameter of the wheels
   double wheel_diam_;
-  /// Vector for pose
-  double odom_pose_[3];
-  /// Vector for velocity
-  double odom_vel_[3];
-  /// Pointer to pose covariance matrix
-  double *pose_cov_[36];
-  /// Pointer to twist covariance matrix
-  double *twist_cov_[36];
+  /// Kinematics of the drive, built from the wheel separation and diameter
+  DiffDriveModel<WheelGeometry> drive_model_;
   /// ROS publisher for odometry messages
   ros::Publisher odom_pub_;
   /// ROS message for odometry data
   nav_msgs::Odometry odom_;
-  /// Flag for (not) publish tf transform for odom -> robot
-  bool publish_tf_;
-  /// TF transform publisher for the odom frame
-  tf::TransformBroadcaster tf_broadcaster_;
+  /// Preallocated odometry messages for intra-process publishing (unused if disabled)
+  MessagePool<nav_msgs::Odometry> odom_pool_;
+  /// TF transform publisher for the odom frame (one of ros_resources_', null unless tf is published)
+  tf::TransformBroadcaster* tf_broadcaster_;
+  /// tf2_ros publisher used instead of tf_broadcaster_ in the tf2 mode, null otherwise
+  tf2_ros::TransformBroadcaster* tf2_broadcaster_;
   /// TF transform for the odom frame
   geometry_msgs::TransformStamped odom_tf_;
-  /// Pointer to left cliff sensor
-  sensors::RaySensorPtr cliff_sensor_left_;
-  /// Pointer to frontal cliff sensor
-  sensors::RaySensorPtr cliff_sensor_center_;
-  /// Pointer to left right sensor
-  sensors::RaySensorPtr cliff_sensor_right_;
+  /// Translation [m] and rotation [rad] the pose has to change by before the transform is sent again
+  double tf_min_translation_;
+  double tf_min_rotation_;
+  /// Pointers to the left, center and right cliff sensors
+  sensors::RaySensorPtr cliff_sensors_[SENSOR_COUNT];
+  /// Flag set by the spinner thread when the sensor topics' subscribers have changed
+  std::atomic<bool> sensor_subscribers_changed_;
+  /// Flat floor the cliff sensors have measured, the sensors are paused while they are over it
+  FloorHeightCache floor_cache_;
+  /// Links the cliff sensors are attached to, and the sensors' poses relative to them (used by the floor cache)
+  physics::LinkPtr cliff_links_[SENSOR_COUNT];
+  api::Pose cliff_poses_[SENSOR_COUNT];
   /// ROS publisher for cliff detection events
   ros::Publisher cliff_event_pub_;
-  /// Kobuki ROS message for cliff event
-  kobuki_msgs::CliffEvent cliff_event_;
-  /// Cliff flag for the left sensor
-  bool cliff_detected_left_;
-  /// Cliff flag for the center sensor
-  bool cliff_detected_center_;
-  /// Cliff flag for the right sensor
-  bool cliff_detected_right_;
-  /// measured distance in meter for detecting a cliff
-  float cliff_detection_threshold_;
+  /// Kobuki ROS messages for the cliff events of the current update, one per sensor
+  kobuki_msgs::CliffEvent cliff_events_[SENSOR_COUNT];
+  /// Publishing schedule of the raw cliff and bumper readings
+  PublishSchedule sensor_state_schedule_;
+  /// ROS publisher for the raw cliff and bumper readings
+  ros::Publisher sensor_state_pub_;
+  /// Kobuki ROS message for the raw cliff and bumper readings, only the cliff, bumper, encoder and battery fields
+  /// are filled
+  kobuki_msgs::SensorState sensor_state_;
   /// Maximum distance to floor
   int floot_dist_;
   /// Pointer to bumper sensor simulating Kobuki's left, centre and right bumper sensors
   sensors::ContactSensorPtr bumper_;
   /// ROS publisher for bumper events
   ros::Publisher bumper_event_pub_;
-  /// Kobuki ROS message for bumper event
-  kobuki_msgs::BumperEvent bumper_event_;
-  /// Flag for left bumper's last state
-  bool bumper_left_was_pressed_;
-  /// Flag for center bumper's last state
-  bool bumper_center_was_pressed_;
-  /// Flag for right bumper's last state
-  bool bumper_right_was_pressed_;
-  /// Flag for left bumper's current state
-  bool bumper_left_is_pressed_;
-  /// Flag for left bumper's current state
-  bool bumper_center_is_pressed_;
-  /// Flag for left bumper's current state
-  bool bumper_right_is_pressed_;
+  /// Kobuki ROS messages for the bumper events of the current update, one per bumper
+  kobuki_msgs::BumperEvent bumper_events_[SENSOR_COUNT];
+  /// Directions covered by the left, centre and right bumper
+  BumperSectors bumper_sectors_;
+  /// Collisions monitored by the bumper sensor, used to pick its contacts from the physics engine's
+  std::vector<physics::CollisionPtr> bumper_collisions_;
   /// Pointer to IMU sensor model
   sensors::ImuSensorPtr imu_;
-  /// Storage for the angular velocity reported by the IMU
-
-  #if GAZEBO_MAJOR_VERSION >= 9
-    ignition::math::Vector3d vel_angular_;
-  #else
-    math::Vector3 vel_angular_;
-  #endif
-
   /// ROS publisher for IMU data
   ros::Publisher imu_pub_;
   /// ROS message for publishing IMU data
   sensor_msgs::Imu imu_msg_;
+  /// Preallocated IMU messages for intra-process publishing (unused if disabled)
+  MessagePool<sensor_msgs::Imu> imu_pool_;
+  /// Publishing schedule of the combined robot state
+  PublishSchedule core_sim_schedule_;
+  /// ROS publisher for the combined robot state
+  ros::Publisher core_sim_pub_;
+  /// ROS message for the combined robot state (null unless it is published)
+  boost::scoped_ptr<kobuki_gazebo_plugins::CoreSim> core_sim_;
+  /// Preallocated combined robot state messages for intra-process publishing (unused if disabled)
+  MessagePool<kobuki_gazebo_plugins::CoreSim> core_sim_pool_;
+  /// Publishing schedule of the decimated telemetry
+  PublishSchedule telemetry_schedule_;
+  /// ROS publisher and message of the decimated telemetry (null unless it is published)
+  ros::Publisher telemetry_pub_;
+  boost::scoped_ptr<kobuki_gazebo_plugins::Telemetry> telemetry_;
+  /// Statistics of the current telemetry window: heading, yaw rate, left/right wheel velocity and battery voltage
+  RunningWindow telemetry_heading_;
+  RunningWindow telemetry_yaw_rate_;
+  RunningWindow telemetry_wheel_vel_[2];
+  RunningWindow telemetry_battery_voltage_;
+  /// Updates aggregated into and simulation time of the start of the current telemetry window
+  unsigned int telemetry_updates_;
+  common::Time telemetry_start_;
+  /// Simulated battery, reported through the sensor state and the telemetry (disabled unless configured)
+  BatteryModel battery_;
+  /// Encoder and gyro noise, applied to the measurements when configured
+  SensorNoiseModel noise_model_;
+  /// Ring file the state of every update is recorded to (not open unless a record file is given)
+  StateRecordFile recorder_;
+  /// Shared memory segment of the external command and state interface (null unless one is given)
+  boost::shared_ptr<SharedStateSegment> shared_segment_;
+  /// This robot's slot in shared_segment_
+  KobukiSharedSlot* shared_slot_;
+  /// Sequence of the shared command taken over last
+  uint32_t shared_cmd_sequence_;
+  /// Update stages timed when timing diagnostics are enabled
+  enum UpdateStage
+  {
+    STAGE_COMMANDS, STAGE_SENSORS, STAGE_JOINT_STATE, STAGE_ODOMETRY, STAGE_IMU,
+    STAGE_VELOCITY_COMMANDS, STAGE_CLIFF, STAGE_BUMPER, STAGE_CORE_SIM, STAGE_RECORD,
+    STAGE_SHARED_MEMORY, STAGE_TELEMETRY, STAGE_COUNT
+  };
+  /// Timing of the update stages, null while timing diagnostics are disabled
+  boost::scoped_ptr<StageProfiler> profiler_;
+  /// Latency of the velocity commands from their arrival, null unless latency tracing is enabled
+  boost::scoped_ptr<CommandLatencyTracer> latency_tracer_;
+  /// Publishing schedule of the timing diagnostics
+  PublishSchedule diagnostics_schedule_;
+  /// ROS publisher for the timing diagnostics
+  ros::Publisher diagnostics_pub_;
+  /// ROS message for the timing diagnostics, one status per stage (null while timing diagnostics are disabled)
+  boost::scoped_ptr<diagnostic_msgs::DiagnosticArray> diagnostics_;
+  /// Bits of state_.outbox
+  enum OutStream
+  {
+    OUT_JOINT_STATE = 1 << 0, OUT_ODOM = 1 << 1, OUT_TF = 1 << 2, OUT_IMU = 1 << 3, OUT_SENSOR_STATE = 1 << 4,
+    OUT_CORE_SIM = 1 << 5, OUT_TELEMETRY = 1 << 6, OUT_DIAGNOSTICS = 1 << 7
+  };
+  /// Pooled messages filled on the current update, null where the member message is filled instead
+  MessagePool<sensor_msgs::JointState>::Ptr joint_state_out_;
+  MessagePool<nav_msgs::Odometry>::Ptr odom_out_;
+  MessagePool<sensor_msgs::Imu>::Ptr imu_out_;
+  MessagePool<kobuki_gazebo_plugins::CoreSim>::Ptr core_sim_out_;
   /// ROS subscriber for reseting the odometry data
   ros::Subscriber odom_reset_sub_;
+  /// Flag set by the spinner thread when an odometry reset has been requested
+  std::atomic<bool> odom_reset_requested_;
 
 
 
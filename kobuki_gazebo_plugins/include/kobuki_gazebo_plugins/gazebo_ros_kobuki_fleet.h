@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2013, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * World plugin running the Kobuki fleet manager.
+ */
+
+#ifndef GAZEBO_ROS_KOBUKI_FLEET_H
+#define GAZEBO_ROS_KOBUKI_FLEET_H
+
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <gazebo/gazebo.hh>
+#include <gazebo/physics/physics.hh>
+#include <ros/ros.h>
+#include "kobuki_gazebo_plugins/StepFleet.h"
+#include "kobuki_gazebo_plugins/ros_resources.h"
+
+namespace gazebo
+{
+
+/**
+ * Loading this world plugin makes all Kobuki plugins loaded after it (i.e. all robots of the world file
+ * and all robots spawned later on) share one batched update, see KobukiFleet.
+ * With batch_tf, their odom transforms are sent together in one tf message at tf_rate.
+ * With lockstep, the world is paused and the kobuki_fleet/step_n service advances it, returning the state of all
+ * robots in lockstep mode in one response.
+ */
+class GazeboRosKobukiFleet : public WorldPlugin
+{
+public:
+  /// Constructor
+  GazeboRosKobukiFleet();
+  /// Destructor
+  ~GazeboRosKobukiFleet();
+  /// Called when plugin is loaded
+  void Load(physics::WorldPtr world, sdf::ElementPtr sdf);
+
+private:
+  /// Callback for the fleet's step_n service
+  bool stepCB(kobuki_gazebo_plugins::StepFleet::Request& req, kobuki_gazebo_plugins::StepFleet::Response& res);
+
+  /// Flag indicating this plugin instance started the fleet manager
+  bool started_;
+  physics::WorldPtr world_;
+  /// Step queue (shared with the robots sharing their ROS resources) and node of the step_n service, null
+  /// without lockstep
+  boost::shared_ptr<RosResources> ros_resources_;
+  boost::scoped_ptr<ros::NodeHandle> nh_;
+  ros::ServiceServer step_service_;
+};
+
+} // namespace gazebo
+
+#endif /* GAZEBO_ROS_KOBUKI_FLEET_H */
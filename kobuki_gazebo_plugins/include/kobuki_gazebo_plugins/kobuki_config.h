@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2013, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Parameters of the Kobuki plugin, read from its SDF description.
+ */
+
+#ifndef KOBUKI_GAZEBO_PLUGINS_KOBUKI_CONFIG_H
+#define KOBUKI_GAZEBO_PLUGINS_KOBUKI_CONFIG_H
+
+#include <string>
+#include <vector>
+#include <sdf/sdf.hh>
+#include "kobuki_gazebo_plugins/diff_drive_model.h"
+#include "kobuki_gazebo_plugins/kobuki_model.h"
+#include "kobuki_gazebo_plugins/noise_model.h"
+
+namespace gazebo
+{
+
+/**
+ * All parameters of the plugin, typed and with their defaults. The plugin's elements are read in one pass,
+ * instead of looking up every parameter by name.
+ */
+struct KobukiConfig
+{
+  KobukiConfig();
+
+  /**
+   * Read the plugin's elements and check them
+   * @param errors missing or invalid required parameters, the plugin can't be loaded with any of them
+   * @param warnings invalid optional parameters, replaced by their defaults
+   * @return false if there are errors
+   */
+  bool parse(const sdf::ElementPtr& sdf, std::vector<std::string>& errors, std::vector<std::string>& warnings);
+
+  /*
+   * Drive (all required)
+   */
+  std::string left_wheel_joint_name;
+  std::string right_wheel_joint_name;
+  /// Separation and diameter of the wheels [m]
+  double wheel_separation;
+  double wheel_diameter;
+  /// Max. torque applied to the wheels [Nm]
+  double torque;
+  /// Time out for velocity commands [s]
+  double velocity_command_timeout;
+  /// Drive the wheels through joint motors ("motor") instead of forcing their velocity ("velocity")
+  bool joint_motors;
+  /// Move the model along the commanded path instead of driving the wheels ("kinematic")
+  bool kinematic;
+  /// Limits of the wheel surfaces' acceleration and deceleration [m/s^2], zero for no limit
+  double wheel_acceleration_limit;
+  double wheel_deceleration_limit;
+  /// Joint velocity error [rad/s] up to which steady joint velocities aren't rewritten
+  double joint_velocity_tolerance;
+
+  /*
+   * Odometry
+   */
+  OdometryIntegrator odom_integrator;
+  bool publish_tf;
+  /// Whether publish_tf was given (it is off otherwise)
+  bool publish_tf_given;
+  /// Broadcast through tf2_ros ("tf2") instead of the legacy tf broadcaster ("tf")
+  bool tf2;
+  /// Only send the odom transform once the pose has moved [m] or turned [rad] by more than these, zero for always
+  double tf_min_translation;
+  double tf_min_rotation;
+  /// Only publish odometry, joint states and IMU data once a value has changed by more than the minimum change of
+  /// its quantity, and at the heartbeat rate [Hz] while none does (also applies to the tf thresholds); a stream
+  /// with all of its minimum changes zero is always published
+  /// Joint positions [rad] and velocities [rad/s]
+  double joint_state_min_position_change;
+  double joint_state_min_velocity_change;
+  /// Odometry position [m], heading [rad], linear [m/s] and angular velocity [rad/s]
+  double odom_min_position_change;
+  double odom_min_orientation_change;
+  double odom_min_linear_velocity_change;
+  double odom_min_angular_velocity_change;
+  /// IMU roll, pitch and yaw [rad], angular velocity [rad/s] and linear acceleration [m/s^2]
+  double imu_min_orientation_change;
+  double imu_min_angular_velocity_change;
+  double imu_min_acceleration_change;
+  double heartbeat_rate;
+
+  /*
+   * Publishing rates [Hz], zero for every update (joint state, odometry, IMU, tf) or for not publishing (others)
+   */
+  double joint_state_rate;
+  double odom_rate;
+  double imu_rate;
+  double tf_rate;
+  double sensor_state_rate;
+  double core_sim_rate;
+  double telemetry_rate;
+  double timing_diagnostics_rate;
+  /// Trace the velocity commands' latency, reported with the timing diagnostics
+  bool latency_tracing;
+  bool intra_process_publishing;
+  /// Share the callback queue, its spinner thread and the tf broadcasters with the other instances of the process
+  bool share_ros_resources;
+  int message_pool_size;
+
+  /*
+   * Sensors (names required)
+   */
+  std::string cliff_sensor_names[SENSOR_COUNT];
+  /// Distance to the floor [m] from which on a cliff is detected, and the hysteresis below it
+  double cliff_detection_threshold;
+  double cliff_detection_hysteresis;
+  bool skip_unchanged_sensors;
+  bool lazy_sensor_activation;
+  /// Floor cache pausing the cliff sensors on known flat floor: cell size [m] (disabled unless given),
+  /// range tolerance [m], measurements per cell and margin [cells]
+  double floor_cache_cell_size;
+  double floor_cache_tolerance;
+  int floor_cache_samples;
+  int floor_cache_margin;
+  std::string bumper_name;
+  /// Kobuki's bumper sectors unless bumper_sector_angles were given
+  BumperSectors bumper_sectors;
+  /// Take the bumper's contacts from the physics engine ("physics") instead of the sensor ("sensor")
+  bool bumper_physics_contacts;
+  std::string imu_name;
+
+  /*
+   * Simulation
+   */
+  bool lockstep;
+  SensorNoiseParameters noise;
+  /// Simulated battery: capacity [Ah] (disabled unless given), current at standstill [A] and per wheel speed [A s/m]
+  double battery_capacity;
+  double battery_base_current;
+  double battery_motor_current;
+  /// Ring file the updates are recorded to, none if empty, and its capacity in records; "%s" in the path is
+  /// replaced by the model name, so all robots of a world can share one setting
+  std::string record_file;
+  int record_capacity;
+  /// Shared memory segment the state is written to and commands are read from, none if empty,
+  /// and its capacity in robots (all robots of a world naming the same segment share it)
+  std::string shared_memory;
+  int shared_memory_capacity;
+};
+
+} // namespace gazebo
+
+#endif /* KOBUKI_GAZEBO_PLUGINS_KOBUKI_CONFIG_H */
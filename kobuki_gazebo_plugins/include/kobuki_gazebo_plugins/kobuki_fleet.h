@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2013, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Batched updates of all Kobuki plugins in a world.
+ */
+
+#ifndef KOBUKI_GAZEBO_PLUGINS_KOBUKI_FLEET_H
+#define KOBUKI_GAZEBO_PLUGINS_KOBUKI_FLEET_H
+
+#include <cstddef>
+#include <vector>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <gazebo/gazebo.hh>
+#include <gazebo/physics/physics.hh>
+#include <geometry_msgs/TransformStamped.h>
+#include <tf2_ros/transform_broadcaster.h>
+#include "kobuki_gazebo_plugins/diff_drive_model.h"
+#include "kobuki_gazebo_plugins/kobuki_model.h"
+#include "kobuki_gazebo_plugins/publish_schedule.h"
+#include "kobuki_gazebo_plugins/ros_resources.h"
+#include "kobuki_gazebo_plugins/worker_pool.h"
+
+namespace gazebo
+{
+
+class GazeboRosKobuki;
+
+/**
+ * Structure-of-arrays snapshot of all managed robots, element i belongs to the i-th registered robot.
+ */
+struct KobukiFleetBatch
+{
+  void resize(std::size_t size);
+
+  /// Step time since the robot's last update [s]
+  std::vector<double> step;
+  /// Drive kinematics
+  std::vector<DiffDriveModel<WheelGeometry> > drive_model;
+  /// Measured left and right wheel joint velocities [rad/s]
+  std::vector<double> wheel_vel[2];
+  /// Gyro yaw rate [rad/s]
+  std::vector<double> yaw_rate;
+  /// Odometry pose [m, m, rad]
+  std::vector<double> odom_x, odom_y, odom_yaw;
+  /// Odometry linear [m/s] and angular [rad/s] velocity
+  std::vector<double> odom_linear_vel, odom_angular_vel;
+  /// Flags returned by DiffDriveModel::integrate
+  std::vector<unsigned int> odom_nan_flags;
+  /// Distances measured by the left, center and right cliff sensors [m]
+  std::vector<double> cliff_range[SENSOR_COUNT];
+  /// Cliff detection threshold and hysteresis [m]
+  std::vector<double> cliff_threshold, cliff_hysteresis;
+  /// Bit mask of the cliff sensors measuring a cliff, on entry the one of the previous update
+  std::vector<unsigned int> cliff_state;
+  /// Bit mask of the pressed bumpers
+  std::vector<unsigned int> bumper_state;
+};
+
+/**
+ * Process-wide manager driving all Kobuki plugins of a world from one update callback.
+ *
+ * It is started by the GazeboRosKobukiFleet world plugin. Kobuki plugins loaded while it runs register
+ * with it instead of connecting to the world update themselves. On each update the manager gathers
+ * the measurements of all robots into a KobukiFleetBatch, integrates odometry and classifies cliffs
+ * for the whole batch and lets every robot build its messages.
+ *
+ * With worker threads, reading the sensors (including the bumper contact classification), the batch math and
+ * building the messages run in parallel on chunks of robots. Taking over the commands (which may switch sensors),
+ * writing the joints, logging and publishing stay on Gazebo's update thread.
+ *
+ * Publishing is not batched: each robot still publishes its own topics, one message per topic and update,
+ * the serial pass only hands the already built messages to roscpp. The one exception is transform batching,
+ * which sends the odom transforms of all robots together in one tf message at the manager's tf rate, instead
+ * of one message per robot.
+ */
+class KobukiFleet
+{
+public:
+  /// The one manager of this process
+  static KobukiFleet& instance();
+
+  /// Start driving the robots of the given world, returns false if the manager is already running
+  bool start(physics::WorldPtr world, unsigned int worker_threads);
+  /// Stop driving the robots; robots still registered will not be updated anymore
+  void stop();
+  /// Send the robots' odom transforms together at the given rate (zero for every update), call after start
+  bool batchTransforms(double rate);
+  /// Register a robot, returns false if the manager isn't running
+  bool add(GazeboRosKobuki* robot);
+  /// Unregister a robot
+  void remove(GazeboRosKobuki* robot);
+
+private:
+  KobukiFleet();
+  KobukiFleet(const KobukiFleet&);
+  KobukiFleet& operator=(const KobukiFleet&);
+
+  /// Called by the world update end event
+  void OnUpdate();
+  /// Process the robots [begin, end): read their measurements, run the math, hand back the results and build
+  /// the messages
+  void process(const common::Time& time_now, std::size_t begin, std::size_t end);
+  /// Copy the robots' measurements into the batch
+  void gather(std::size_t begin, std::size_t end);
+  /// Run the update math over the batch
+  void compute(std::size_t begin, std::size_t end);
+  /// Hand the results back to the robots
+  void scatter(std::size_t begin, std::size_t end);
+  /// Let the robots build their messages
+  void fill(const common::Time& time_now, std::size_t begin, std::size_t end);
+  /// Let each robot publish its built messages and write its joints, one robot after the other
+  void publish();
+  /// Send the odom transforms of all robots in one message
+  void publishTransforms();
+
+  /// Protects the registered robots; robots are added and removed while Gazebo loads and deletes models
+  boost::mutex mutex_;
+  /// Pointer to the managed world, empty while not running
+  physics::WorldPtr world_;
+  /// Connection to the world update end event
+  event::ConnectionPtr update_connection_;
+  /// Registered robots
+  std::vector<GazeboRosKobuki*> robots_;
+  /// State of all registered robots on the current update
+  KobukiFleetBatch batch_;
+  /// Worker threads for processing chunks of robots in parallel
+  boost::scoped_ptr<WorkerPool> workers_;
+  /// Process-wide ROS resources providing the publisher of the batched transforms (the same tf2 broadcaster
+  /// the robots sharing their resources use), both null unless transform batching is enabled
+  boost::shared_ptr<RosResources> ros_resources_;
+  tf2_ros::TransformBroadcaster* tf_broadcaster_;
+  PublishSchedule tf_schedule_;
+  /// Whether the batched transforms are sent on the current update
+  bool transforms_due_;
+  /// Transforms of the current batch, reused between updates
+  std::vector<geometry_msgs::TransformStamped> transforms_;
+};
+
+} // namespace gazebo
+
+#endif /* KOBUKI_GAZEBO_PLUGINS_KOBUKI_FLEET_H */
@@ -0,0 +1,225 @@
+/*
+ * Copyright (c) 2013, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Gazebo-independent parts of the Kobuki update math, shared by the plugin and the fleet manager.
+ */
+
+#ifndef KOBUKI_GAZEBO_PLUGINS_KOBUKI_MODEL_H
+#define KOBUKI_GAZEBO_PLUGINS_KOBUKI_MODEL_H
+
+#include <cmath>
+#include <stdint.h>
+
+namespace gazebo
+{
+
+/// Indices of the left, center and right cliff sensors and bumpers (same as in kobuki_msgs' events)
+enum {SENSOR_LEFT = 0, SENSOR_CENTER = 1, SENSOR_RIGHT = 2, SENSOR_COUNT = 3};
+
+/**
+ * Cliff detection: bit i is set if sensor i measures at least the threshold distance to the floor.
+ * A sensor that measured a cliff on the previous update (bit i of previous_cliffs) only returns to the floor
+ * once it measures less than threshold - hysteresis, so noisy edges don't toggle the state on every update.
+ */
+inline unsigned int classifyCliffs(const double range[SENSOR_COUNT], unsigned int previous_cliffs,
+                                   double threshold, double hysteresis)
+{
+  unsigned int cliffs = 0;
+  for (unsigned int i = 0; i < SENSOR_COUNT; ++i)
+  {
+    double sensor_threshold = threshold - hysteresis * ((previous_cliffs >> i) & 1u);
+    cliffs |= (range[i] >= sensor_threshold ? 1u : 0u) << i;
+  }
+  return cliffs;
+}
+
+/// Wheel rotation per encoder tick [rad] (the Kobuki driver's tick_to_rad, about 2578 ticks per revolution)
+const double KOBUKI_TICK_TO_RAD = 0.002436916871363930187454;
+
+/**
+ * Encoder count of a wheel joint's position, not wrapped
+ */
+inline int64_t wheelEncoderCount(double joint_position)
+{
+  return (int64_t)std::floor(joint_position / KOBUKI_TICK_TO_RAD);
+}
+
+/**
+ * Encoder reading of a real Kobuki wheel (wrapping at 16 bits) for the wheel joint's position
+ */
+inline uint16_t wheelEncoderTicks(double joint_position)
+{
+  return (uint16_t)wheelEncoderCount(joint_position);
+}
+
+/**
+ * Convert a cliff sensor's distance to the floor back to the AD reading the real sensor would report
+ */
+inline int cliffRangeToAD(double range)
+{
+  return (int)(76123.0f * std::atan2(0.995f, range));
+}
+
+/**
+ * cliffRangeToAD by linear interpolation in a table with one entry per millimetre, exact at the entries and
+ * at most one count off in between. Ranges beyond the table fall back to the exact conversion.
+ */
+class CliffADTable
+{
+public:
+  CliffADTable()
+  {
+    for (unsigned int i = 0; i <= SIZE; ++i)
+    {
+      table_[i] = 76123.0f * std::atan2(0.995f, (double)i / ENTRIES_PER_METER);
+    }
+  }
+
+  int operator()(double range) const
+  {
+    double position = range * ENTRIES_PER_METER;
+    // also sends NaN to the exact conversion
+    if (!(position >= 0.0 && position < SIZE))
+    {
+      return cliffRangeToAD(range);
+    }
+    unsigned int i = (unsigned int)position;
+    return (int)(table_[i] + (position - i) * (table_[i + 1] - table_[i]));
+  }
+
+  /// Table shared by all users, built on first use
+  static const CliffADTable& instance()
+  {
+    static const CliffADTable table;
+    return table;
+  }
+
+private:
+  enum {ENTRIES_PER_METER = 1000, SIZE = 512};
+
+  double table_[SIZE + 1];
+};
+
+/**
+ * Only contacts at the height of the bumper should be considered, but since a simplified collision model is
+ * used, contacts further below and above (relative to the robot's origin) need to be considered as well to
+ * identify "bumps" reliably.
+ */
+inline bool isBumperContactHeight(double relative_contact_height)
+{
+  return (relative_contact_height >= 0.01) && (relative_contact_height <= 0.13);
+}
+
+/**
+ * In order to simulate the three bumper sensors, a contact is assigned to one of the bumpers depending on
+ * its direction. By default each sensor covers a range of 60 degrees.
+ * +90 ... +30: left bumper
+ * +30 ... -30: centre bumper
+ * -30 ... -90: right bumper
+ * Instead of comparing angles, a contact direction is tested against the normals of the sector boundaries,
+ * which are rotated into the world frame once per update (setHeading).
+ */
+class BumperSectors
+{
+public:
+  BumperSectors()
+  {
+    const double kobuki_boundaries[SENSOR_COUNT + 1] = {M_PI/2, M_PI/6, -M_PI/6, -M_PI/2};
+    setBoundaries(kobuki_boundaries);
+  }
+
+  /**
+   * Set the sector boundaries (relative to the robot's heading, in radians) in descending order, from the
+   * left bumper's outer edge to the right bumper's outer edge. Sector i lies between boundaries i and i + 1.
+   * @return false (and keeps the previous boundaries) if they are not descending or a sector spans 180 degrees
+   *         or more
+   */
+  bool setBoundaries(const double boundaries[SENSOR_COUNT + 1])
+  {
+    for (unsigned int i = 0; i < SENSOR_COUNT; ++i)
+    {
+      double width = boundaries[i] - boundaries[i + 1];
+      if (!(width > 0.0 && width < M_PI))
+      {
+        return false;
+      }
+    }
+    for (unsigned int i = 0; i <= SENSOR_COUNT; ++i)
+    {
+      boundaries_[i] = boundaries[i];
+    }
+    setHeading(0.0);
+    return true;
+  }
+
+  /// Sector boundary i relative to the robot's heading [rad]
+  double boundary(unsigned int i) const { return boundaries_[i]; }
+
+  /**
+   * Rotate the sector boundaries into the world frame for the robot's current heading
+   */
+  void setHeading(double robot_heading)
+  {
+    for (unsigned int i = 0; i <= SENSOR_COUNT; ++i)
+    {
+      // normal pointing towards increasing angles
+      normal_x_[i] = -std::sin(boundaries_[i] + robot_heading);
+      normal_y_[i] = std::cos(boundaries_[i] + robot_heading);
+    }
+  }
+
+  /**
+   * The contact normal is given in world coordinates and points from the contact to the robot centre.
+   * @return bit of the pressed bumper (1 << SENSOR_LEFT etc.), 0 if the contact is outside the bumpers
+   */
+  unsigned int classify(double normal_x, double normal_y) const
+  {
+    // direction from the robot centre to the contact
+    double x = -normal_x;
+    double y = -normal_y;
+    for (unsigned int i = 0; i < SENSOR_COUNT; ++i)
+    {
+      if ((x * normal_x_[i] + y * normal_y_[i] <= 0.0) && (x * normal_x_[i + 1] + y * normal_y_[i + 1] >= 0.0))
+      {
+        return 1u << i;
+      }
+    }
+    return 0;
+  }
+
+private:
+  double boundaries_[SENSOR_COUNT + 1];
+  double normal_x_[SENSOR_COUNT + 1];
+  double normal_y_[SENSOR_COUNT + 1];
+};
+
+} // namespace gazebo
+
+#endif /* KOBUKI_GAZEBO_PLUGINS_KOBUKI_MODEL_H */
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2013, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Heap memory held by standard containers, for the plugin's memory report. Sizes are the ones requested from
+ * the allocator, its own bookkeeping and rounding aren't counted.
+ */
+
+#ifndef KOBUKI_GAZEBO_PLUGINS_MEMORY_USAGE_H
+#define KOBUKI_GAZEBO_PLUGINS_MEMORY_USAGE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace gazebo
+{
+
+/// Heap held by a string [bytes], short strings are stored in the string object itself
+inline std::size_t heapUsage(const std::string& s)
+{
+  static const std::size_t inline_capacity = std::string().capacity();
+  return (s.capacity() > inline_capacity) ? s.capacity() + 1 : 0;
+}
+
+/// Heap held by a vector's buffer [bytes], not counting what its elements hold themselves
+template <typename T>
+std::size_t bufferUsage(const std::vector<T>& v)
+{
+  return v.capacity() * sizeof(T);
+}
+
+/// Heap held by a vector of strings [bytes]
+inline std::size_t heapUsage(const std::vector<std::string>& v)
+{
+  std::size_t usage = bufferUsage(v);
+  for (std::size_t i = 0; i < v.size(); ++i)
+  {
+    usage += heapUsage(v[i]);
+  }
+  return usage;
+}
+
+/**
+ * Heap held by a deque [bytes], not counting what its elements hold themselves. The deque doesn't tell its
+ * layout, this is libstdc++'s: nodes of 512 bytes (or of one element if that is larger), at least one of them
+ * even while empty, and a map of node pointers with two spare entries and no less than eight.
+ */
+template <typename T>
+std::size_t bufferUsage(const std::deque<T>& d)
+{
+  const std::size_t per_node = (sizeof(T) < 512) ? 512 / sizeof(T) : 1;
+  const std::size_t nodes = d.size() / per_node + 1;
+  return nodes * per_node * sizeof(T) + std::max<std::size_t>(8, nodes + 2) * sizeof(T*);
+}
+
+} // namespace gazebo
+
+#endif /* KOBUKI_GAZEBO_PLUGINS_MEMORY_USAGE_H */
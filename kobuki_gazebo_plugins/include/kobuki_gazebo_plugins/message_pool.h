@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2013, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Preallocated messages for publishing to in-process subscribers without serialization.
+ */
+
+#ifndef KOBUKI_GAZEBO_PLUGINS_MESSAGE_POOL_H
+#define KOBUKI_GAZEBO_PLUGINS_MESSAGE_POOL_H
+
+#include <cstddef>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+
+namespace gazebo
+{
+
+/**
+ * Small ring of preallocated messages. Messages published as shared pointers are handed to
+ * in-process subscribers (nodelets, other Gazebo plugins) without being serialized, so a message
+ * is only reused once no subscriber queue holds on to it anymore.
+ */
+template <typename M>
+class MessagePool
+{
+public:
+  typedef boost::shared_ptr<M> Ptr;
+
+  MessagePool() : next_(0) {}
+
+  /// Allocate the ring, every message starts as a copy of the prototype (invariant fields filled)
+  void init(std::size_t size, const M& prototype)
+  {
+    prototype_ = prototype;
+    pool_.clear();
+    for (std::size_t i = 0; i < size; ++i)
+    {
+      pool_.push_back(Ptr(new M(prototype_)));
+    }
+    next_ = 0;
+  }
+
+  /// Pooled publishing is enabled once the ring has been allocated
+  bool enabled() const { return !pool_.empty(); }
+
+  /// Number of messages in the ring
+  std::size_t size() const { return pool_.size(); }
+
+  /**
+   * Heap memory held [bytes]: the ring, its messages with their reference counts and what the messages and the
+   * prototype hold, as told by heap
+   */
+  std::size_t memoryUsage(std::size_t (*heap)(const M&)) const
+  {
+    std::size_t usage = pool_.capacity() * sizeof(Ptr) + heap(prototype_);
+    for (std::size_t i = 0; i < pool_.size(); ++i)
+    {
+      usage += sizeof(M) + sizeof(boost::detail::sp_counted_impl_p<M>) + heap(*pool_[i]);
+    }
+    return usage;
+  }
+
+  /// Hand out the next message which nobody else references
+  Ptr acquire()
+  {
+    for (std::size_t i = 0; i < pool_.size(); ++i)
+    {
+      Ptr& msg = advance();
+      if (msg.use_count() == 1)
+        return msg;
+    }
+    // all messages are still queued somewhere, replace the oldest one
+    Ptr& msg = advance();
+    msg.reset(new M(prototype_));
+    return msg;
+  }
+
+private:
+  Ptr& advance()
+  {
+    Ptr& msg = pool_[next_];
+    next_ = (next_ + 1) % pool_.size();
+    return msg;
+  }
+
+  std::vector<Ptr> pool_;
+  std::size_t next_;
+  M prototype_;
+};
+
+} // namespace gazebo
+
+#endif /* KOBUKI_GAZEBO_PLUGINS_MESSAGE_POOL_H */
@@ -0,0 +1,271 @@
+/*
+ * Copyright (c) 2013, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Encoder and gyro noise of the simulated Kobuki, independent of Gazebo and ROS.
+ */
+
+#ifndef KOBUKI_GAZEBO_PLUGINS_NOISE_MODEL_H
+#define KOBUKI_GAZEBO_PLUGINS_NOISE_MODEL_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <random>
+#include <vector>
+#include "kobuki_gazebo_plugins/kobuki_model.h"
+
+namespace gazebo
+{
+
+/**
+ * Standard normal samples, generated ahead into a small preallocated ring so drawing one is an index increment.
+ * topUp() replaces the samples drawn since its last call in one short batch (Box-Muller over an array, no
+ * branches, vectorizes), so calling it once per update spreads the generation evenly over the updates.
+ * Holds no memory until configured.
+ */
+class GaussianNoiseBuffer
+{
+public:
+  GaussianNoiseBuffer() : next_(0), available_(0), generator_(0) {}
+
+  /**
+   * Hold capacity samples, generated in batches of size batch (both rounded up to even), and fill them
+   */
+  void configure(std::size_t capacity, std::size_t batch, unsigned int seed)
+  {
+    batch += batch & 1;
+    capacity = std::max(capacity + (capacity & 1), batch);
+    std::vector<double>(capacity).swap(samples_);
+    std::vector<double>(batch).swap(batch_);
+    generator_.seed(seed);
+    next_ = 0;
+    available_ = 0;
+    while (samples_.size() - available_ >= batch_.size())
+    {
+      generate();
+    }
+  }
+
+  /// Release the samples
+  void clear()
+  {
+    std::vector<double>().swap(samples_);
+    std::vector<double>().swap(batch_);
+    next_ = 0;
+    available_ = 0;
+  }
+
+  /// Heap memory held [bytes]
+  std::size_t memoryUsage() const { return (samples_.capacity() + batch_.capacity()) * sizeof(double); }
+
+  /// Draw a sample, only after configuring
+  double next()
+  {
+    if (available_ == 0)
+    {
+      // drawn more than topUp() replaced
+      generate();
+    }
+    double sample = samples_[next_];
+    next_ = (next_ + 1 == samples_.size()) ? 0 : next_ + 1;
+    --available_;
+    return sample;
+  }
+
+  /// Replace the samples drawn, one batch at most
+  void topUp()
+  {
+    if (!batch_.empty() && (samples_.size() - available_ >= batch_.size()))
+    {
+      generate();
+    }
+  }
+
+private:
+  /// Generate a batch behind the available samples, in place in batch_ and then copied into the ring
+  void generate()
+  {
+    // uniforms in (0, 1], so the logarithm stays finite
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    for (std::size_t i = 0; i < batch_.size(); ++i)
+    {
+      batch_[i] = 1.0 - uniform(generator_);
+    }
+    const std::size_t half = batch_.size() / 2;
+    for (std::size_t i = 0; i < half; ++i)
+    {
+      double radius = std::sqrt(-2.0 * std::log(batch_[i]));
+      double angle = 2.0 * M_PI * batch_[half + i];
+      batch_[i] = radius * std::cos(angle);
+      batch_[half + i] = radius * std::sin(angle);
+    }
+    std::size_t write = (next_ + available_) % samples_.size();
+    for (std::size_t i = 0; i < batch_.size(); ++i)
+    {
+      samples_[write] = batch_[i];
+      write = (write + 1 == samples_.size()) ? 0 : write + 1;
+    }
+    available_ += batch_.size();
+  }
+
+  std::vector<double> samples_;
+  std::vector<double> batch_;
+  /// Next sample to draw, and the samples available from there on
+  std::size_t next_;
+  std::size_t available_;
+  std::mt19937 generator_;
+};
+
+/**
+ * Noise settings, all models are off by default
+ */
+struct SensorNoiseParameters
+{
+  SensorNoiseParameters()
+    : encoder_quantisation(false), wheel_slip_stddev(0.0),
+      gyro_noise_stddev(0.0), gyro_bias(0.0), gyro_drift_stddev(0.0), seed(0), seeded(false) {}
+
+  bool enabled() const
+  {
+    return encoder_quantisation || (wheel_slip_stddev > 0.0) ||
+           (gyro_noise_stddev > 0.0) || (gyro_bias != 0.0) || (gyro_drift_stddev > 0.0);
+  }
+
+  /// Derive the wheel velocities from whole encoder ticks, as the driver does
+  bool encoder_quantisation;
+  /// Relative wheel slip, i.e. standard deviation of the factor applied to a wheel's velocity
+  double wheel_slip_stddev;
+  /// Standard deviation of the gyro's white noise [rad/s]
+  double gyro_noise_stddev;
+  /// Initial gyro bias [rad/s]
+  double gyro_bias;
+  /// Random walk of the gyro bias [rad/s/sqrt(s)]
+  double gyro_drift_stddev;
+  /// Seed of the noise generator; an explicit seed (seeded) makes a run reproducible, without one the plugin
+  /// derives it from the model's name, so the robots of a world draw independent noise
+  unsigned int seed;
+  bool seeded;
+};
+
+/**
+ * Turns the wheel joints' and IMU's true values into what the Kobuki's encoders and gyro would measure
+ */
+class SensorNoiseModel
+{
+public:
+  SensorNoiseModel() : bias_(0.0), initialised_(false)
+  {
+    encoder_count_[0] = encoder_count_[1] = 0;
+  }
+
+  void configure(const SensorNoiseParameters& parameters)
+  {
+    parameters_ = parameters;
+    std::size_t draws = drawsPerUpdate();
+    if (draws > 0)
+    {
+      noise_.configure(draws * HORIZON_UPDATES, draws, parameters.seed);
+    }
+    else
+    {
+      noise_.clear();
+    }
+    bias_ = parameters.gyro_bias;
+    initialised_ = false;
+  }
+
+  bool enabled() const { return parameters_.enabled(); }
+  const SensorNoiseParameters& parameters() const { return parameters_; }
+  /// Heap memory held [bytes]
+  std::size_t memoryUsage() const { return noise_.memoryUsage(); }
+
+  /**
+   * Measured wheel velocities [rad/s] over the last step, given the joint positions [rad] and velocities
+   * (replaced in place)
+   */
+  void measureWheels(double step, const double position[2], double velocity[2])
+  {
+    for (unsigned int side = 0; side < 2; ++side)
+    {
+      if (parameters_.encoder_quantisation)
+      {
+        int64_t count = wheelEncoderCount(position[side]);
+        velocity[side] = (initialised_ && step > 0.0)
+                         ? (count - encoder_count_[side]) * KOBUKI_TICK_TO_RAD / step : 0.0;
+        encoder_count_[side] = count;
+      }
+      if (parameters_.wheel_slip_stddev > 0.0)
+      {
+        velocity[side] *= 1.0 + parameters_.wheel_slip_stddev * noise_.next();
+      }
+    }
+    initialised_ = true;
+  }
+
+  /**
+   * Measured yaw rate [rad/s], given the true one; the bias drifts with every step
+   */
+  double measureYawRate(double step, double yaw_rate)
+  {
+    if (parameters_.gyro_drift_stddev > 0.0 && step > 0.0)
+    {
+      bias_ += parameters_.gyro_drift_stddev * std::sqrt(step) * noise_.next();
+    }
+    double noise = (parameters_.gyro_noise_stddev > 0.0) ? parameters_.gyro_noise_stddev * noise_.next() : 0.0;
+    return yaw_rate + bias_ + noise;
+  }
+
+  /// Generate the samples for the next update; call once per update, after measuring
+  void replenish()
+  {
+    noise_.topUp();
+  }
+
+private:
+  /// Updates the generated samples last for at most (the buffer is replenished on every update)
+  enum { HORIZON_UPDATES = 8 };
+
+  /// Samples drawn by an update
+  std::size_t drawsPerUpdate() const
+  {
+    return ((parameters_.wheel_slip_stddev > 0.0) ? 2 : 0) + ((parameters_.gyro_drift_stddev > 0.0) ? 1 : 0) +
+           ((parameters_.gyro_noise_stddev > 0.0) ? 1 : 0);
+  }
+
+  SensorNoiseParameters parameters_;
+  GaussianNoiseBuffer noise_;
+  double bias_;
+  int64_t encoder_count_[2];
+  bool initialised_;
+};
+
+} // namespace gazebo
+
+#endif /* KOBUKI_GAZEBO_PLUGINS_NOISE_MODEL_H */
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2013, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Sim-time based scheduling of the plugin's outgoing message streams.
+ */
+
+#ifndef KOBUKI_GAZEBO_PLUGINS_PUBLISH_SCHEDULE_H
+#define KOBUKI_GAZEBO_PLUGINS_PUBLISH_SCHEDULE_H
+
+#include <gazebo/common/Time.hh>
+
+namespace gazebo
+{
+
+/**
+ * Tells on which world updates a stream is due for publishing. A rate of zero (the default)
+ * makes the stream due on every update, i.e. at the physics rate.
+ */
+class PublishSchedule
+{
+public:
+  PublishSchedule() : period_(0.0), next_(0.0) {}
+
+  /// Set the publishing rate in Hz
+  void setRate(double rate)
+  {
+    period_ = (rate > 0.0) ? common::Time(1.0 / rate) : common::Time(0.0);
+    next_ = common::Time(0.0);
+  }
+
+  /// True if the stream runs at the physics rate
+  bool everyUpdate() const { return period_ == common::Time(0.0); }
+
+  /// Returns true if the stream is due at the given sim time and schedules the next slot
+  bool due(const common::Time& now)
+  {
+    if (everyUpdate())
+      return true;
+    if (now + period_ < next_)
+    {
+      // sim time jumped back, e.g. after a world reset
+      next_ = now;
+    }
+    if (now < next_)
+      return false;
+    next_ += period_;
+    if (next_ <= now)
+    {
+      // fell behind by more than one period, don't try to catch up
+      next_ = now + period_;
+    }
+    return true;
+  }
+
+private:
+  common::Time period_;
+  common::Time next_;
+};
+
+} // namespace gazebo
+
+#endif /* KOBUKI_GAZEBO_PLUGINS_PUBLISH_SCHEDULE_H */
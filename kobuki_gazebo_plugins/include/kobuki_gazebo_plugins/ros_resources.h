@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2013, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * The ROS infrastructure of the plugin that doesn't depend on the robot: the callback queues with their spinner
+ * threads and the tf broadcasters. Either owned by one plugin instance or shared by all instances of a process.
+ */
+
+#ifndef KOBUKI_GAZEBO_PLUGINS_ROS_RESOURCES_H
+#define KOBUKI_GAZEBO_PLUGINS_ROS_RESOURCES_H
+
+#include <atomic>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <ros/ros.h>
+#include <ros/callback_queue.h>
+#include <tf/transform_broadcaster.h>
+#include <tf2_ros/transform_broadcaster.h>
+
+namespace gazebo
+{
+
+/**
+ * Callback queue served by a spinner thread of its own, so plugins don't serve the global queue, and
+ * tf broadcasters created on first use. The broadcasters may be used from any thread.
+ * Callbacks blocking until the world has advanced (the lockstep services) go to the step queue instead,
+ * served by a second thread, so they don't hold up the velocity commands and other callbacks meanwhile.
+ */
+class RosResources
+{
+public:
+  /// Resources for a single plugin instance
+  RosResources();
+  /// Stops the spinner; callbacks of the users should have been removed (e.g. by shutting their node down)
+  ~RosResources();
+
+  /// The resources shared by all plugin instances of the process asking for them, kept while any uses them
+  static boost::shared_ptr<RosResources> shared();
+
+  ros::CallbackQueue& callbackQueue() { return callback_queue_; }
+  /// Start serving the callback queue (once)
+  void startSpinner();
+  ros::CallbackQueue& stepQueue() { return step_queue_; }
+  /// Start serving the step queue (once)
+  void startStepSpinner();
+
+  tf::TransformBroadcaster& tfBroadcaster();
+  tf2_ros::TransformBroadcaster& tf2Broadcaster();
+
+  /// Heap memory held [bytes] beyond sizeof(RosResources), not counting roscpp's own allocations
+  std::size_t memoryUsage() const;
+  /// Number of spinner threads started, each with a stack of its own that memoryUsage doesn't count
+  unsigned int spinnerThreads() const;
+
+private:
+  RosResources(const RosResources&);
+  RosResources& operator=(const RosResources&);
+
+  void spin(ros::CallbackQueue* queue);
+
+  ros::CallbackQueue callback_queue_;
+  boost::scoped_ptr<boost::thread> spinner_thread_;
+  ros::CallbackQueue step_queue_;
+  boost::scoped_ptr<boost::thread> step_spinner_thread_;
+  std::atomic<bool> shutdown_requested_;
+  /// Guards starting the spinners and creating the broadcasters
+  boost::mutex mutex_;
+  boost::scoped_ptr<tf::TransformBroadcaster> tf_broadcaster_;
+  boost::scoped_ptr<tf2_ros::TransformBroadcaster> tf2_broadcaster_;
+};
+
+} // namespace gazebo
+
+#endif /* KOBUKI_GAZEBO_PLUGINS_ROS_RESOURCES_H */
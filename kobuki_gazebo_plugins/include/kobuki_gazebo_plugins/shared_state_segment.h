@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2013, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * POSIX shared memory segment through which external processes (e.g. training workers) read the state of the
+ * simulated Kobukis and command them, without going through ROS.
+ */
+
+#ifndef KOBUKI_GAZEBO_PLUGINS_SHARED_STATE_SEGMENT_H
+#define KOBUKI_GAZEBO_PLUGINS_SHARED_STATE_SEGMENT_H
+
+#include <atomic>
+#include <cstddef>
+#include <string>
+#include <stdint.h>
+#include <boost/shared_ptr.hpp>
+#include "kobuki_gazebo_plugins/state_record_file.h"
+
+namespace gazebo
+{
+
+/**
+ * Value with seqlock versioning, for one writer and any number of readers in any process.
+ * The sequence is odd while the value is being written and advances by two with each write,
+ * so readers neither block the writer nor see a torn value.
+ */
+template <typename T>
+struct SeqLocked
+{
+  /// Writer side
+  void write(const T& new_value)
+  {
+    uint32_t sequence_before = sequence.load(std::memory_order_relaxed);
+    sequence.store(sequence_before + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    value = new_value;
+    sequence.store(sequence_before + 2, std::memory_order_release);
+  }
+
+  /**
+   * Reader side: copy the value, fails instead of waiting if it is being written
+   * @param read_sequence the sequence of the copied value, i.e. twice the number of writes
+   */
+  bool read(T& copy, uint32_t& read_sequence) const
+  {
+    uint32_t sequence_before = sequence.load(std::memory_order_acquire);
+    if (sequence_before & 1)
+    {
+      return false;
+    }
+    copy = value;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    read_sequence = sequence_before;
+    return sequence.load(std::memory_order_relaxed) == sequence_before;
+  }
+
+  std::atomic<uint32_t> sequence;
+  T value;
+};
+
+/**
+ * Velocity command written by the external process
+ */
+struct KobukiSharedCommand
+{
+  /// Linear [m/s] and angular [rad/s] velocity, as in a geometry_msgs/Twist on commands/velocity
+  double linear_velocity;
+  double angular_velocity;
+};
+
+/**
+ * One robot's slot. The parts written by the plugin and by the external process lie on cache lines of their own.
+ */
+struct alignas(64) KobukiSharedSlot
+{
+  /// 1 while a robot owns the slot, robot_name is valid then
+  std::atomic<uint32_t> in_use;
+  /// Name of the robot's model, null terminated
+  char robot_name[60];
+  /// Written by the plugin at the end of every update
+  alignas(64) SeqLocked<KobukiStateRecord> state;
+  /// Written by the external process, taken over by the plugin at the start of the next update
+  alignas(64) SeqLocked<KobukiSharedCommand> command;
+};
+
+/**
+ * Segment layout: a header followed by capacity slots. The plugins of one process share the segment,
+ * each robot claims the first free slot and marks it with its name.
+ */
+class SharedStateSegment
+{
+public:
+  /**
+   * The segment of the given name (e.g. "/kobuki_sim"), created with room for capacity robots by the first
+   * robot opening it and removed again when the last one releases it
+   */
+  static boost::shared_ptr<SharedStateSegment> open(const std::string& name, std::size_t capacity);
+  ~SharedStateSegment();
+
+  /// Claim a free slot for the robot, null if all are taken
+  KobukiSharedSlot* claim(const std::string& robot_name);
+  void release(KobukiSharedSlot* slot);
+
+  const std::string& name() const { return name_; }
+  std::size_t capacity() const;
+  /// Index of a claimed slot, as seen by the external process
+  std::size_t index(const KobukiSharedSlot* slot) const { return slot - slots_; }
+
+private:
+  SharedStateSegment(const std::string& name);
+  SharedStateSegment(const SharedStateSegment&);
+  SharedStateSegment& operator=(const SharedStateSegment&);
+
+  bool create(std::size_t capacity);
+
+  struct alignas(64) Header
+  {
+    char magic[8];
+    uint32_t version;
+    uint32_t slot_size;
+    uint32_t capacity;
+    /// Slots claimed so far, readers only need to look at these
+    std::atomic<uint32_t> slot_count;
+  };
+
+  std::string name_;
+  Header* header_;
+  KobukiSharedSlot* slots_;
+  std::size_t mapped_size_;
+};
+
+} // namespace gazebo
+
+#endif /* KOBUKI_GAZEBO_PLUGINS_SHARED_STATE_SEGMENT_H */
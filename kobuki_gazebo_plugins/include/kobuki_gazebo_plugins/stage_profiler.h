@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2013, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Low-overhead timing of the plugin's update stages.
+ */
+
+#ifndef KOBUKI_GAZEBO_PLUGINS_STAGE_PROFILER_H
+#define KOBUKI_GAZEBO_PLUGINS_STAGE_PROFILER_H
+
+#include <chrono>
+#include <cstddef>
+#include <stdint.h>
+#include <vector>
+
+namespace gazebo
+{
+
+/**
+ * Keeps a log-scale histogram (four buckets per power of two) of the time spent in each stage per update,
+ * from which min/mean/p99/max are reported for the window since the last reset. Durations measured during
+ * an update are accumulated per stage and entered into the histograms by commit(). Neither allocates.
+ */
+class StageProfiler
+{
+public:
+  /// Statistics of one stage in microseconds
+  struct Statistics
+  {
+    uint64_t count;
+    double min;
+    double mean;
+    double p99;
+    double max;
+  };
+
+  explicit StageProfiler(std::size_t stages);
+
+  /// Add time spent in a stage during the current update, in nanoseconds
+  void accumulate(std::size_t stage, uint64_t nsec)
+  {
+    pending_[stage] += nsec;
+    ran_[stage] = true;
+  }
+  /// End of an update: add one sample per stage that ran
+  void commit();
+  /// Add a sample in nanoseconds
+  void add(std::size_t stage, uint64_t nsec);
+  /// Statistics over the current window
+  Statistics statistics(std::size_t stage) const;
+  /// Start a new window
+  void reset();
+  /// Number of stages
+  std::size_t stages() const { return histograms_.size(); }
+  /// Heap memory held [bytes]
+  std::size_t memoryUsage() const
+  {
+    return histograms_.capacity() * sizeof(Histogram) + pending_.capacity() * sizeof(uint64_t) +
+           (ran_.capacity() + 7) / 8;
+  }
+
+private:
+  enum { BUCKETS = 256 };
+
+  struct Histogram
+  {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+    uint32_t buckets[BUCKETS];
+  };
+
+  static std::size_t bucket(uint64_t nsec);
+  static uint64_t bucketUpperBound(std::size_t bucket);
+
+  std::vector<Histogram> histograms_;
+  std::vector<uint64_t> pending_;
+  std::vector<bool> ran_;
+};
+
+/**
+ * Accounts the lifetime of the timer to a stage. Does nothing if no profiler is given, which is the case
+ * as long as timing is disabled.
+ */
+class StageTimer
+{
+public:
+  StageTimer(StageProfiler* profiler, std::size_t stage) : profiler_(profiler), stage_(stage)
+  {
+    if (profiler_)
+      start_ = std::chrono::steady_clock::now();
+  }
+
+  ~StageTimer()
+  {
+    if (profiler_)
+      profiler_->accumulate(stage_, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             std::chrono::steady_clock::now() - start_).count());
+  }
+
+private:
+  StageProfiler* profiler_;
+  std::size_t stage_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+} // namespace gazebo
+
+#endif /* KOBUKI_GAZEBO_PLUGINS_STAGE_PROFILER_H */
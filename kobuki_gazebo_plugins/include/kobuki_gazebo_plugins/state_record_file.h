@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2013, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Memory-mapped ring file of fixed-size Kobuki state records, written by the plugin and read by the replay tool.
+ */
+
+#ifndef KOBUKI_GAZEBO_PLUGINS_STATE_RECORD_FILE_H
+#define KOBUKI_GAZEBO_PLUGINS_STATE_RECORD_FILE_H
+
+#include <atomic>
+#include <cstddef>
+#include <string>
+#include <stdint.h>
+
+namespace gazebo
+{
+
+/**
+ * State of one robot after one update. Plain data, stored as is in the file.
+ */
+struct KobukiStateRecord
+{
+  /// Simulation time of the update
+  int32_t sim_sec;
+  uint32_t sim_nsec;
+  /// Wheel joint positions [rad] and velocities [rad/s], left and right
+  double wheel_position[2];
+  double wheel_velocity[2];
+  /// Odometry pose [m, m, rad], linear [m/s] and angular [rad/s] velocity
+  double odom_pose[3];
+  double odom_linear_vel;
+  double odom_angular_vel;
+  /// IMU orientation (x, y, z, w), angular velocity [rad/s] and linear acceleration [m/s^2]
+  double imu_orientation[4];
+  double imu_angular_vel[3];
+  double imu_linear_acc[3];
+  /// Distances measured by the left, center and right cliff sensors [m]
+  double cliff_range[3];
+  /// Bit masks of the cliff sensors measuring a cliff and of the pressed bumpers (bit SENSOR_LEFT etc.)
+  uint32_t cliff_state;
+  uint32_t bumper_state;
+};
+
+/**
+ * File layout: a header followed by capacity records. Record n is stored in slot n % capacity, so the file
+ * always holds the latest capacity records. The writer publishes a record by incrementing the header's record
+ * count after writing it, readers may follow a file that is still being written.
+ */
+class StateRecordFile
+{
+public:
+  StateRecordFile();
+  ~StateRecordFile();
+
+  /// Create (or truncate) the file with room for capacity records and map it for writing; fails while another
+  /// instance of the process writes to the same path
+  bool create(const std::string& path, std::size_t capacity);
+  /// Map an existing file for reading
+  bool open(const std::string& path);
+  void close();
+
+  bool isOpen() const { return header_ != NULL; }
+  /// Number of records the ring holds
+  std::size_t capacity() const;
+  /// Number of records written so far (including the ones already overwritten)
+  uint64_t count() const;
+  /// Size of the file's mapping [bytes], zero while not open
+  std::size_t mappedSize() const { return mapped_size_; }
+
+  /// Writer side: append a record (no system calls, the kernel writes the pages back)
+  void append(const KobukiStateRecord& record);
+  /// Reader side: record n, only valid for count() - capacity() <= n < count()
+  const KobukiStateRecord& record(uint64_t n) const;
+
+private:
+  StateRecordFile(const StateRecordFile&);
+  StateRecordFile& operator=(const StateRecordFile&);
+
+  struct Header
+  {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t capacity;
+    std::atomic<uint64_t> count;
+  };
+
+  bool map(int fd, std::size_t size, bool writable);
+
+  Header* header_;
+  KobukiStateRecord* records_;
+  std::size_t mapped_size_;
+  /// Path written to, registered with the paths the process writes to; empty unless created
+  std::string write_path_;
+};
+
+} // namespace gazebo
+
+#endif /* KOBUKI_GAZEBO_PLUGINS_STATE_RECORD_FILE_H */
@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2013, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Incremental aggregation of the decimated telemetry and the simulated battery, independent of Gazebo and ROS.
+ */
+
+#ifndef KOBUKI_GAZEBO_PLUGINS_TELEMETRY_H
+#define KOBUKI_GAZEBO_PLUGINS_TELEMETRY_H
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace gazebo
+{
+
+/**
+ * Min, max and mean of a value over a window, in constant time and space per sample
+ */
+class RunningWindow
+{
+public:
+  RunningWindow()
+  {
+    reset();
+  }
+
+  void add(double value)
+  {
+    min_ = std::min(min_, value);
+    max_ = std::max(max_, value);
+    sum_ += value;
+    ++count_;
+  }
+
+  void reset()
+  {
+    min_ = std::numeric_limits<double>::infinity();
+    max_ = -std::numeric_limits<double>::infinity();
+    sum_ = 0.0;
+    count_ = 0;
+  }
+
+  /// Copy the statistics into a message with min, max and mean fields (all zero for an empty window)
+  template <typename Message>
+  void fill(Message& msg) const
+  {
+    msg.min = count_ ? min_ : 0.0;
+    msg.max = count_ ? max_ : 0.0;
+    msg.mean = count_ ? sum_ / count_ : 0.0;
+  }
+
+private:
+  double min_;
+  double max_;
+  double sum_;
+  unsigned long count_;
+};
+
+/**
+ * Battery draining with a constant base current plus a current proportional to the wheel speeds; the voltage
+ * drops linearly with the charge (from 16.7 V when full to 13.2 V, the Kobuki's dangerous level, when empty).
+ */
+class BatteryModel
+{
+public:
+  BatteryModel() : capacity_(0.0), base_current_(0.0), motor_current_(0.0), full_voltage_(16.7),
+                   empty_voltage_(13.2), charge_(1.0) {}
+
+  /**
+   * @param capacity [Ah], zero or less disables the model
+   * @param base_current current drawn at standstill [A]
+   * @param motor_current current drawn per wheel and m/s of wheel speed [A s/m]
+   */
+  void configure(double capacity, double base_current, double motor_current)
+  {
+    capacity_ = capacity;
+    base_current_ = base_current;
+    motor_current_ = motor_current;
+    charge_ = 1.0;
+  }
+  bool enabled() const { return capacity_ > 0.0; }
+
+  /// Drain the battery over a step [s] at the given wheel speeds [m/s]
+  void update(double step, double left_speed, double right_speed)
+  {
+    double current = base_current_ + motor_current_ * (std::fabs(left_speed) + std::fabs(right_speed));
+    charge_ = std::max(0.0, charge_ - current * step / (3600.0 * capacity_));
+  }
+
+  /// Remaining charge [0..1] and the voltage [V] at it
+  double charge() const { return charge_; }
+  double voltage() const { return empty_voltage_ + charge_ * (full_voltage_ - empty_voltage_); }
+
+private:
+  double capacity_;
+  double base_current_;
+  double motor_current_;
+  double full_voltage_;
+  double empty_voltage_;
+  double charge_;
+};
+
+} // namespace gazebo
+
+#endif /* KOBUKI_GAZEBO_PLUGINS_TELEMETRY_H */
@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2013, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Acceleration limited velocity commands of the Kobuki's wheels, independent of Gazebo and ROS.
+ */
+
+#ifndef KOBUKI_GAZEBO_PLUGINS_VELOCITY_SMOOTHER_H
+#define KOBUKI_GAZEBO_PLUGINS_VELOCITY_SMOOTHER_H
+
+#include <algorithm>
+#include <cmath>
+
+namespace gazebo
+{
+
+/**
+ * Ramps the wheel speeds towards the commanded ones within the acceleration and deceleration limits.
+ * When a wheel can't reach its target within the step, both wheels' ramps are shortened together,
+ * so the robot keeps turning the way the command asks while it ramps. A wheel reversing its direction
+ * decelerates down to zero and accelerates from there.
+ */
+class VelocitySmoother
+{
+public:
+  VelocitySmoother() : acceleration_(0.0), deceleration_(0.0)
+  {
+    reset();
+  }
+
+  /**
+   * Limits of the wheel surfaces' acceleration and deceleration [m/s^2], zero or less for no limit
+   */
+  void setLimits(double acceleration, double deceleration)
+  {
+    acceleration_ = acceleration;
+    deceleration_ = deceleration;
+  }
+  double acceleration() const { return acceleration_; }
+  double deceleration() const { return deceleration_; }
+
+  /// Stop at once, e.g. when the motors are switched off
+  void reset()
+  {
+    speed_[0] = 0.0;
+    speed_[1] = 0.0;
+  }
+
+  /// Wheel speed [m/s] after the last update
+  double speed(unsigned int side) const { return speed_[side]; }
+
+  /// Whether the wheel speeds haven't reached the targets yet
+  bool ramping(const double target[2]) const
+  {
+    return (speed_[0] != target[0]) || (speed_[1] != target[1]);
+  }
+
+  /**
+   * Advance the wheel speeds by one step [s] towards the target speeds [m/s]
+   * @return whether the wheel speeds changed, e.g. not on a zero step
+   */
+  bool update(double step, const double target[2])
+  {
+    if (!ramping(target))
+    {
+      return false;
+    }
+    double ramp_time[2] = {rampTime(0, target[0]), rampTime(1, target[1])};
+    double longest = std::max(ramp_time[0], ramp_time[1]);
+    if (longest <= step)
+    {
+      // reach the targets exactly, so ramping ends
+      speed_[0] = target[0];
+      speed_[1] = target[1];
+      return true;
+    }
+    if (step <= 0.0)
+    {
+      return false;
+    }
+    // both wheels cover the same fraction of their ramps
+    double fraction = step / longest;
+    double previous[2] = {speed_[0], speed_[1]};
+    speed_[0] = rampedSpeed(0, target[0], fraction * ramp_time[0]);
+    speed_[1] = rampedSpeed(1, target[1], fraction * ramp_time[1]);
+    return (speed_[0] != previous[0]) || (speed_[1] != previous[1]);
+  }
+
+private:
+  /// Time [s] a change by delta [m/s] takes within the limit (zero if unlimited)
+  static double changeTime(double limit, double delta)
+  {
+    return (limit > 0.0) ? std::fabs(delta) / limit : 0.0;
+  }
+
+  /// Time [s] the wheel needs to reach the target speed: slowing down (to zero at most) within the deceleration,
+  /// speeding up (from zero at least) within the acceleration
+  double rampTime(unsigned int side, double target) const
+  {
+    double speed = speed_[side];
+    if (speed * target < 0.0)
+    {
+      return changeTime(deceleration_, speed) + changeTime(acceleration_, target);
+    }
+    if (std::fabs(target) < std::fabs(speed))
+    {
+      return changeTime(deceleration_, target - speed);
+    }
+    return changeTime(acceleration_, target - speed);
+  }
+
+  /// Wheel speed [m/s] after ramping towards the target for the given time, shorter than its ramp time
+  double rampedSpeed(unsigned int side, double target, double time) const
+  {
+    double speed = speed_[side];
+    if (speed * target < 0.0)
+    {
+      double stop_time = changeTime(deceleration_, speed);
+      if (time >= stop_time)
+      {
+        // through zero, the rest speeds up in the target's direction
+        return std::copysign(acceleration_ * (time - stop_time), target);
+      }
+      return speed - std::copysign(deceleration_ * time, speed);
+    }
+    double limit = (std::fabs(target) < std::fabs(speed)) ? deceleration_ : acceleration_;
+    if (limit <= 0.0)
+    {
+      return target;
+    }
+    return speed + std::copysign(limit * time, target - speed);
+  }
+
+  double acceleration_;
+  double deceleration_;
+  double speed_[2];
+};
+
+} // namespace gazebo
+
+#endif /* KOBUKI_GAZEBO_PLUGINS_VELOCITY_SMOOTHER_H */
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2013, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Minimal thread pool for running the fleet's per-robot work in parallel.
+ */
+
+#ifndef KOBUKI_GAZEBO_PLUGINS_WORKER_POOL_H
+#define KOBUKI_GAZEBO_PLUGINS_WORKER_POOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+
+namespace gazebo
+{
+
+/**
+ * Fixed set of worker threads executing parallel loops. The calling thread takes part in the work, chunks
+ * of the index range are handed out dynamically, so a slow robot doesn't hold up a whole thread's share,
+ * and parallelFor only returns once every chunk is done.
+ */
+class WorkerPool
+{
+public:
+  /// Task processing the index range [begin, end)
+  typedef boost::function<void (std::size_t begin, std::size_t end)> Task;
+
+  /// Start the given number of worker threads (zero runs everything on the calling thread)
+  explicit WorkerPool(unsigned int threads);
+  ~WorkerPool();
+
+  /// Run the task over [0, count) in chunks of up to grain indices and wait until all are done
+  void parallelFor(std::size_t count, std::size_t grain, const Task& task);
+
+  /// Number of worker threads (not counting the calling thread)
+  unsigned int threads() const { return threads_.size(); }
+
+private:
+  WorkerPool(const WorkerPool&);
+  WorkerPool& operator=(const WorkerPool&);
+
+  void work();
+  void runChunks();
+
+  boost::thread_group threads_;
+  boost::mutex mutex_;
+  boost::condition_variable start_condition_;
+  boost::condition_variable done_condition_;
+  /// Current loop, valid while busy_ is non-zero
+  const Task* task_;
+  std::size_t count_;
+  std::size_t grain_;
+  std::atomic<std::size_t> next_;
+  /// Incremented for every loop, wakes up the workers
+  unsigned int generation_;
+  /// Workers still working on the current loop
+  unsigned int busy_;
+  bool shutdown_;
+};
+
+} // namespace gazebo
+
+#endif /* KOBUKI_GAZEBO_PLUGINS_WORKER_POOL_H */
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2013, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Process-wide coordination of the lockstep mode's step requests.
+ */
+
+#ifndef KOBUKI_GAZEBO_PLUGINS_WORLD_STEPPER_H
+#define KOBUKI_GAZEBO_PLUGINS_WORLD_STEPPER_H
+
+#include <vector>
+#include <boost/thread/mutex.hpp>
+#include <gazebo/physics/physics.hh>
+#include "kobuki_gazebo_plugins/StepFleet.h"
+#include "kobuki_gazebo_plugins/StepN.h"
+
+namespace gazebo
+{
+
+class GazeboRosKobuki;
+
+/**
+ * Advances the world for the step_n services of the robots in lockstep mode and of the fleet, one request at a
+ * time: World::Step is shared by all of them, so a request arriving while another one runs is rejected instead
+ * of overwriting its step count. Requests block their (service) thread until the world has advanced.
+ */
+class WorldStepper
+{
+public:
+  enum Result
+  {
+    /// The world advanced by all steps, the results are filled
+    STEPPED,
+    /// Another request is running
+    BUSY,
+    /// The world stopped before finishing the steps, or the request was invalid
+    FAILED
+  };
+
+  /// The one stepper of this process
+  static WorldStepper& instance();
+
+  /// Register a robot in lockstep mode, once it is updated
+  void add(GazeboRosKobuki* robot);
+  /// Unregister a robot
+  void remove(GazeboRosKobuki* robot);
+
+  /// Queue the commands for the robot, advance the world and return the robot's state after the last step
+  Result step(physics::World& world, GazeboRosKobuki& robot,
+              const kobuki_gazebo_plugins::StepN::Request& req, kobuki_gazebo_plugins::StepN::Response& res);
+  /// Queue the commands for their robots, advance the world and return the state of all registered robots
+  Result step(physics::World& world,
+              const kobuki_gazebo_plugins::StepFleet::Request& req, kobuki_gazebo_plugins::StepFleet::Response& res);
+
+private:
+  WorldStepper() {}
+  WorldStepper(const WorldStepper&);
+  WorldStepper& operator=(const WorldStepper&);
+
+  /// Advance the world, the results of the given robots (all registered ones if null) are captured on the last
+  /// step; returns whether all steps were done
+  bool advance(physics::World& world, unsigned int steps, GazeboRosKobuki* robot);
+  /// Registered robot of the given model name, null if none
+  GazeboRosKobuki* find(const std::string& name) const;
+
+  /// Held by the running request
+  boost::mutex step_mutex_;
+  /// Protects the registered robots; robots are added and removed while Gazebo loads and deletes models
+  boost::mutex mutex_;
+  std::vector<GazeboRosKobuki*> robots_;
+};
+
+} // namespace gazebo
+
+#endif /* KOBUKI_GAZEBO_PLUGINS_WORLD_STEPPER_H */
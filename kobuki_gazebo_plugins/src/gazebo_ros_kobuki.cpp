@@ -1,41 +1,103 @@
 
 #include <cmath>
 #include <cstring>
+#include <limits>
 #include <boost/bind.hpp>
 #include <sensor_msgs/JointState.h>
 #include <tf/LinearMath/Quaternion.h>
 #include "kobuki_gazebo_plugins/gazebo_ros_kobuki.h"
-#if GAZEBO_MAJOR_VERSION >= 9
-  // #include <ignition/math.hh>
-  #include <ignition/math/Vector3.hh>
-  #include <ignition/math/Quaternion.hh>
-#else
-  #include <gazebo/math/gzmath.hh>
-#endif
+#include "kobuki_gazebo_plugins/kobuki_fleet.h"
 
 namespace gazebo
 {
 
 
-GazeboRosKobuki::GazeboRosKobuki() : shutdown_requested_(false)
+GazeboRosKobuki::GazeboRosKobuki() : motors_enabled_(true), step_updates_remaining_(0),
+                                     sensor_subscribers_changed_(false), odom_reset_requested_(false)
 {
   // Initialise variables
-  wheel_speed_cmd_[LEFT] = 0.0;
-  wheel_speed_cmd_[RIGHT] = 0.0;
-  cliff_detected_left_ = false;
-  cliff_detected_center_ = false;
-  cliff_detected_right_ = false;
+  state_.fleet_managed = false;
+  state_.lockstep = false;
+  state_.wheel_speed_cmd[LEFT] = 0.0;
+  state_.wheel_speed_cmd[RIGHT] = 0.0;
+  state_.joint_vel[LEFT] = 0.0;
+  state_.joint_vel[RIGHT] = 0.0;
+  state_.update_step = 0.0;
+  update_count_ = 0;
+  joint_velocity_tolerance_ = 0.0;
+  joint_writes_ = 0;
+  state_.joint_motors = false;
+  state_.joint_motor_force = 0.0;
+  state_.kinematic = false;
+  state_.wheel_speeds_changed = false;
+  tf_broadcaster_ = NULL;
+  tf2_broadcaster_ = NULL;
+  state_.kinematic_wheel_position[0] = 0.0;
+  state_.kinematic_wheel_position[1] = 0.0;
+  state_.cliff_detected = 0;
+  state_.bumper_was_pressed = 0;
+  state_.bumper_is_pressed = 0;
+  state_.bumper_physics_contacts = false;
+  state_.skip_unchanged_sensors = true;
+  state_.lazy_sensor_activation = false;
+  state_.cliff_sensors_active = true;
+  state_.bumper_active = true;
+  state_.cliff_sensors_paused = false;
+  state_.cliff_sensors_pausing = false;
+  state_.outbox = 0;
+  state_.cliff_events_out = 0;
+  state_.bumper_events_out = 0;
+  state_.cliff_state = 0;
+  state_.cliff_detection_hysteresis = 0.0;
+  // what the sensors report until their first measurement
+  for (unsigned int i = 0; i < SENSOR_COUNT; ++i)
+  {
+    state_.cliff_range[i] = 0.0;
+  }
+  state_.publish_sensor_state = false;
+  state_.publish_core_sim = false;
+  state_.publish_telemetry = false;
+  telemetry_updates_ = 0;
+  state_.tf_batched = false;
+  tf_min_translation_ = 0.0;
+  tf_min_rotation_ = 0.0;
+  // nothing sent yet, so the first transform passes the change thresholds
+  state_.tf_sent_pose[0] = std::numeric_limits<double>::quiet_NaN();
+  state_.tf_sent_pose[1] = std::numeric_limits<double>::quiet_NaN();
+  state_.tf_sent_pose[2] = std::numeric_limits<double>::quiet_NaN();
+  state_.tf_sent_time = std::numeric_limits<double>::quiet_NaN();
+  heartbeat_period_ = 0.0;
+  shared_slot_ = NULL;
+  shared_cmd_sequence_ = 0;
 }
 
 GazeboRosKobuki::~GazeboRosKobuki()
 {
-//  rosnode_->shutdown();
-  shutdown_requested_ = true;
-  // Wait for spinner thread to end
-//  ros_spinner_thread_->join();
-
-  //  delete spinner_thread_;
-//  delete rosnode_;
+  update_connection_.reset();
+  if (state_.fleet_managed)
+  {
+    KobukiFleet::instance().remove(this);
+  }
+  if (state_.lockstep)
+  {
+    WorldStepper::instance().remove(this);
+  }
+  // waits for a step request in progress
+  if (step_nh_)
+  {
+    step_nh_->shutdown();
+  }
+  // Stop serving our callbacks before we go away: shutting the node down removes them from the (possibly shared)
+  // queue and waits for the ones in progress; an own queue's spinner thread ends with ros_resources_
+  if (gazebo_ros_)
+  {
+    gazebo_ros_->node()->shutdown();
+  }
+  ros_resources_.reset();
+  if (shared_slot_)
+  {
+    shared_segment_->release(shared_slot_);
+  }
 }
 
 void GazeboRosKobuki::Load(physics::ModelPtr parent, sdf::ElementPtr sdf)
@@ -48,7 +110,6 @@ void GazeboRosKobuki::Load(physics::ModelPtr parent, sdf::ElementPtr sdf)
   }
 
   gazebo_ros_ = GazeboRosPtr(new GazeboRos(model_, sdf, "Kobuki"));
-  sdf_ = sdf;
 
   // Make sure the ROS node for Gazebo has already been initialized
   if (!ros::isInitialized())
@@ -64,73 +125,330 @@ void GazeboRosKobuki::Load(physics::ModelPtr parent, sdf::ElementPtr sdf)
   node_name_ = model_name;
   world_ = parent->GetWorld();
 
+  std::vector<std::string> errors;
+  std::vector<std::string> warnings;
+  config_.reset(new KobukiConfig());
+  bool valid = config_->parse(sdf, errors, warnings);
+  for (std::size_t i = 0; i < warnings.size(); ++i)
+  {
+    ROS_WARN_STREAM(warnings[i] << " [" << node_name_ <<"]");
+  }
+  if (!valid)
+  {
+    for (std::size_t i = 0; i < errors.size(); ++i)
+    {
+      ROS_ERROR_STREAM(errors[i] << " [" << node_name_ <<"]");
+    }
+    return;
+  }
+
   prepareMotorPower();
   preparePublishTf();
+  preparePublishRates();
 
   if(prepareJointState() == false)
     return;
-  if(prepareWheelAndTorque() == false)
-    return;
+  prepareWheelAndTorque();
 
   prepareOdom();
 
-  if(prepareVelocityCommand() == false)
-    return;
+  prepareVelocityCommand();
   if(prepareCliffSensor() == false)
     return;
   if(prepareBumper() == false)
     return;
   if(prepareIMU() == false)
     return;
+  prepareTimingDiagnostics();
+  prepareLatencyTracing();
+  prepareLockstep();
+  prepareCoreSim();
+  prepareTelemetry();
+  prepareRecorder();
+  prepareSharedMemory();
+  prepareNoise();
+  prepareSensorActivation();
+  prepareFloorCache();
 
   setupRosApi(model_name);
+  prepareMessagePools();
+  updateSensorActivation();
+  // everything needed later on has been taken over from the parameters
+  config_.reset();
 
-  #if GAZEBO_MAJOR_VERSION >= 9
-    prev_update_time_ = world_->SimTime();
-  #else
-    prev_update_time_ = world_->GetSimTime();
-  #endif
+  state_.prev_update_time = api::simTime(*world_);
+
+  ros_resources_->startSpinner();
+  if (state_.lockstep)
+  {
+    WorldStepper::instance().add(this);
+    ros_resources_->startStepSpinner();
+  }
+  reportMemoryUsage();
 
   ROS_INFO_STREAM("GazeboRosKobuki plugin ready to go! [" << node_name_ << "]");
-  update_connection_ = event::Events::ConnectWorldUpdateEnd(boost::bind(&GazeboRosKobuki::OnUpdate, this));
+  // with a fleet manager running in this world, let it drive our updates together with all others
+  state_.fleet_managed = KobukiFleet::instance().add(this);
+  if (state_.fleet_managed)
+  {
+    ROS_INFO_STREAM("Updates are batched by the Kobuki fleet manager. [" << node_name_ << "]");
+  }
+  else
+  {
+    update_connection_ = event::Events::ConnectWorldUpdateEnd(boost::bind(&GazeboRosKobuki::OnUpdate, this));
+  }
 
 }
 
 
 void GazeboRosKobuki::OnUpdate()
 {
-  /*
-   * First process ROS callbacks
-   */
-  ros::spinOnce();
-
   /*
    * Update current time and time step
    */
-  common::Time time_now;
-  #if GAZEBO_MAJOR_VERSION >= 9
-    time_now = world_->SimTime();
-  #else
-    time_now = world_->GetSimTime();
-  #endif
-
-  common::Time step_time = time_now - prev_update_time_;
-  prev_update_time_ = time_now;
+  common::Time time_now = api::simTime(*world_);
 
-  updateJointState();
+  common::Time step_time = beginUpdate(time_now);
+  readSensors(step_time);
   updateOdometry(step_time);
-  updateIMU();
-  propagateVelocityCommands();
-  updateCliffSensor();
-  updateBumper();
+  state_.cliff_state = classifyCliffs(state_.cliff_range, state_.cliff_state,
+                                      state_.cliff_detection_threshold, state_.cliff_detection_hysteresis);
+  fillMessages(time_now);
+  publishMessages();
+}
+
+/*
+ * Start an update: advance the time and take over what the ROS callbacks received since the last update
+ * (never blocks); runs on the update thread, as it may switch sensors on and off
+ */
+common::Time GazeboRosKobuki::beginUpdate(const common::Time& time_now)
+{
+  StageTimer timer(profiler_.get(), STAGE_COMMANDS);
+  common::Time step_time = time_now - state_.prev_update_time;
+  state_.prev_update_time = time_now;
+  state_.update_step = step_time.Double();
+  update_count_.fetch_add(1, std::memory_order_relaxed);
+
+  WheelSpeedCommand cmd;
+  if (cmd_vel_slot_.read(cmd))
+  {
+    state_.last_cmd_vel_time = time_now;
+    state_.wheel_speed_cmd[LEFT] = cmd.wheel_speed[LEFT];
+    state_.wheel_speed_cmd[RIGHT] = cmd.wheel_speed[RIGHT];
+    if (latency_tracer_)
+    {
+      latency_tracer_->accept(cmd.trace);
+    }
+  }
+  if (shared_slot_)
+  {
+    readSharedCommand(time_now);
+  }
+  if (state_.lockstep)
+  {
+    applyStampedCommands(time_now);
+  }
+  if (sensor_subscribers_changed_.exchange(false))
+  {
+    updateSensorActivation();
+  }
+  if (odom_reset_requested_.exchange(false))
+  {
+    state_.odom_pose[0] = 0.0;
+    state_.odom_pose[1] = 0.0;
+    state_.odom_pose[2] = 0.0;
+  }
+  // from the sim time already at hand, ros::Time::now() would take the ROS clock's lock; the same under use_sim_time
+  state_.update_stamp = ros::Time(time_now.sec, time_now.nsec);
+  return step_time;
+}
+
+/*
+ * Finish an update once odometry and cliff state are up to date: fill the messages of the streams that are due,
+ * ramp the velocity commands and detect sensor events. Only touches the robot's own data, publishMessages then
+ * hands the results to roscpp and Gazebo.
+ */
+void GazeboRosKobuki::fillMessages(const common::Time& time_now)
+{
+  StageProfiler* profiler = profiler_.get();
+  state_.outbox = 0;
+  // odometry is integrated on every update, messages are only built for the streams that are due
+  if (joint_state_schedule_.due(time_now))
+  {
+    StageTimer timer(profiler, STAGE_JOINT_STATE);
+    updateJointState();
+  }
+  if (odom_schedule_.due(time_now))
+  {
+    StageTimer timer(profiler, STAGE_ODOMETRY);
+    updateOdometryMessage();
+  }
+  if (state_.publish_tf && !state_.tf_batched && tf_schedule_.due(time_now))
+  {
+    StageTimer timer(profiler, STAGE_ODOMETRY);
+    if (fillTf())
+    {
+      state_.outbox |= OUT_TF;
+    }
+  }
+  if (imu_schedule_.due(time_now))
+  {
+    StageTimer timer(profiler, STAGE_IMU);
+    updateIMU();
+  }
+  {
+    StageTimer timer(profiler, STAGE_VELOCITY_COMMANDS);
+    updateVelocitySmoother(time_now);
+  }
+  {
+    StageTimer timer(profiler, STAGE_CLIFF);
+    updateCliffSensor();
+  }
+  if (state_.publish_sensor_state && sensor_state_schedule_.due(time_now))
+  {
+    StageTimer timer(profiler, STAGE_CLIFF);
+    updateSensorState();
+  }
+  {
+    StageTimer timer(profiler, STAGE_BUMPER);
+    updateBumper();
+  }
+  if (state_.publish_core_sim && core_sim_schedule_.due(time_now))
+  {
+    StageTimer timer(profiler, STAGE_CORE_SIM);
+    updateCoreSim();
+  }
+  if (state_.publish_telemetry || battery_.enabled())
+  {
+    StageTimer timer(profiler, STAGE_TELEMETRY);
+    updateTelemetry(time_now);
+  }
+  if (recorder_.isOpen())
+  {
+    StageTimer timer(profiler, STAGE_RECORD);
+    recordState(time_now);
+  }
+  if (shared_slot_)
+  {
+    StageTimer timer(profiler, STAGE_SHARED_MEMORY);
+    writeSharedState(time_now);
+  }
+  if (state_.lockstep)
+  {
+    captureStepResult(time_now);
+  }
+  // the statistics of the updates committed so far, this one's stages are committed by publishMessages
+  if (profiler && diagnostics_schedule_.due(time_now))
+  {
+    updateTimingDiagnostics();
+  }
 }
 
-void GazeboRosKobuki::spin()
+/*
+ * Publishes a message filled by fillMessages, from the pool if it was taken from there
+ */
+template <typename M>
+static void publishFilled(const ros::Publisher& publisher, boost::shared_ptr<M>& pooled, const M& member)
 {
-  ros::Rate r(10);
-  while(ros::ok() && !shutdown_requested_)
+  if (pooled)
   {
-    r.sleep();
+    publisher.publish(pooled);
+    // back to the pool once the subscribers are done with it
+    pooled.reset();
+  }
+  else
+  {
+    publisher.publish(member);
+  }
+}
+
+/*
+ * Second half of an update, on the update thread: write the joints (or move the model), switch the cliff sensors
+ * and publish what fillMessages has filled
+ */
+void GazeboRosKobuki::publishMessages()
+{
+  StageProfiler* profiler = profiler_.get();
+  {
+    StageTimer timer(profiler, STAGE_VELOCITY_COMMANDS);
+    propagateVelocityCommands();
+  }
+  if (state_.cliff_sensors_pausing != state_.cliff_sensors_paused)
+  {
+    StageTimer timer(profiler, STAGE_CLIFF);
+    pauseCliffSensors();
+  }
+  if (state_.outbox & OUT_JOINT_STATE)
+  {
+    StageTimer timer(profiler, STAGE_JOINT_STATE);
+    publishFilled(joint_state_pub_, joint_state_out_, joint_state_);
+  }
+  if (state_.outbox & OUT_ODOM)
+  {
+    StageTimer timer(profiler, STAGE_ODOMETRY);
+    publishFilled(odom_pub_, odom_out_, odom_);
+  }
+  // batched transforms are sent by the KobukiFleet
+  if ((state_.outbox & OUT_TF) && !state_.tf_batched)
+  {
+    StageTimer timer(profiler, STAGE_ODOMETRY);
+    if (tf2_broadcaster_)
+    {
+      tf2_broadcaster_->sendTransform(odom_tf_);
+    }
+    else
+    {
+      tf_broadcaster_->sendTransform(odom_tf_);
+    }
+  }
+  if (state_.outbox & OUT_IMU)
+  {
+    StageTimer timer(profiler, STAGE_IMU);
+    publishFilled(imu_pub_, imu_out_, imu_msg_);
+  }
+  if (state_.cliff_events_out || (state_.outbox & OUT_SENSOR_STATE))
+  {
+    StageTimer timer(profiler, STAGE_CLIFF);
+    for (unsigned int i = 0; i < SENSOR_COUNT; ++i)
+    {
+      if (state_.cliff_events_out & (1u << i))
+      {
+        cliff_event_pub_.publish(cliff_events_[i]);
+      }
+    }
+    if (state_.outbox & OUT_SENSOR_STATE)
+    {
+      sensor_state_pub_.publish(sensor_state_);
+    }
+  }
+  if (state_.bumper_events_out)
+  {
+    StageTimer timer(profiler, STAGE_BUMPER);
+    for (unsigned int i = 0; i < SENSOR_COUNT; ++i)
+    {
+      if (state_.bumper_events_out & (1u << i))
+      {
+        bumper_event_pub_.publish(bumper_events_[i]);
+      }
+    }
+  }
+  if (state_.outbox & OUT_CORE_SIM)
+  {
+    StageTimer timer(profiler, STAGE_CORE_SIM);
+    publishFilled(core_sim_pub_, core_sim_out_, *core_sim_);
+  }
+  if (state_.outbox & OUT_TELEMETRY)
+  {
+    StageTimer timer(profiler, STAGE_TELEMETRY);
+    telemetry_pub_.publish(*telemetry_);
+  }
+  if (profiler)
+  {
+    profiler->commit();
+  }
+  if (state_.outbox & OUT_DIAGNOSTICS)
+  {
+    diagnostics_pub_.publish(*diagnostics_);
   }
 }
 
@@ -148,23 +466,184 @@ void GazeboRosKobuki::motorPowerCB(const kobuki_msgs::MotorPowerPtr &msg)
   }
 }
 
+/*
+ * Runs on the spinner thread, so the sensors are switched by the next update
+ */
+void GazeboRosKobuki::sensorSubscribersCB(const ros::SingleSubscriberPublisher &subscriber)
+{
+  sensor_subscribers_changed_ = true;
+}
+
+/*
+ * Run the cliff and bumper sensors only while something uses their readings: subscribers of the topics
+ * carrying them, the recorder, the shared memory interface or the lockstep mode's step results. The IMU always
+ * runs, odometry needs it.
+ */
+void GazeboRosKobuki::updateSensorActivation()
+{
+  if (!state_.lazy_sensor_activation)
+  {
+    return;
+  }
+  bool always = state_.lockstep || recorder_.isOpen() || (shared_slot_ != NULL);
+  bool raw_readings = (sensor_state_pub_.getNumSubscribers() > 0) || (core_sim_pub_.getNumSubscribers() > 0);
+  bool cliff_sensors_active = always || raw_readings || (cliff_event_pub_.getNumSubscribers() > 0);
+  bool bumper_active = always || raw_readings || (bumper_event_pub_.getNumSubscribers() > 0);
+  if (cliff_sensors_active != state_.cliff_sensors_active)
+  {
+    for (unsigned int i = 0; i < SENSOR_COUNT; ++i)
+    {
+      cliff_sensors_[i]->SetActive(cliff_sensors_active);
+    }
+    state_.cliff_sensors_active = cliff_sensors_active;
+    state_.cliff_sensors_paused = false;
+    state_.cliff_sensors_pausing = false;
+    ROS_INFO_STREAM((cliff_sensors_active ? "Activated" : "Deactivated") << " the cliff sensors."
+                    << " [" << node_name_ <<"]");
+  }
+  if (bumper_active != state_.bumper_active)
+  {
+    bumper_->SetActive(bumper_active);
+    state_.bumper_active = bumper_active;
+    ROS_INFO_STREAM((bumper_active ? "Activated" : "Deactivated") << " the bumper sensor."
+                    << " [" << node_name_ <<"]");
+  }
+}
+
+/*
+ * Runs on the spinner thread; the command is stamped with the sim time once OnUpdate takes it over.
+ */
 void GazeboRosKobuki::cmdVelCB(const geometry_msgs::TwistConstPtr &msg)
 {
-  #if GAZEBO_MAJOR_VERSION >= 9
-    last_cmd_vel_time_ = world_->SimTime();
-  #else
-    last_cmd_vel_time_ = world_->GetSimTime();
-  #endif
+  WheelSpeedCommand cmd;
+  drive_model_.wheelSpeeds(msg->linear.x, msg->angular.z, cmd.wheel_speed[LEFT], cmd.wheel_speed[RIGHT]);
+  if (latency_tracer_)
+  {
+    cmd.trace = CommandLatencyTracer::tag(update_count_.load(std::memory_order_relaxed));
+  }
+  cmd_vel_slot_.write(cmd);
+}
+
+/*
+ * Take over the command an external process wrote to the shared memory slot since the last update.
+ * Never waits for the writer: a command caught while being written is retried a few times, then left
+ * to the next update.
+ */
+void GazeboRosKobuki::readSharedCommand(const common::Time& time_now)
+{
+  static const int read_attempts = 3;
+  KobukiSharedCommand command;
+  uint32_t sequence;
+  for (int attempt = 0; attempt < read_attempts; ++attempt)
+  {
+    if (!shared_slot_->command.read(command, sequence))
+    {
+      continue;
+    }
+    if (sequence != shared_cmd_sequence_)
+    {
+      shared_cmd_sequence_ = sequence;
+      state_.last_cmd_vel_time = time_now;
+      drive_model_.wheelSpeeds(command.linear_velocity, command.angular_velocity,
+                               state_.wheel_speed_cmd[LEFT], state_.wheel_speed_cmd[RIGHT]);
+    }
+    return;
+  }
+}
+
+/*
+ * Lockstep mode
+ */
+void GazeboRosKobuki::cmdVelStampedCB(const geometry_msgs::TwistStampedConstPtr &msg)
+{
+  queueStampedCommand(*msg);
+}
+
+void GazeboRosKobuki::queueStampedCommand(const geometry_msgs::TwistStamped& msg)
+{
+  // bounds the queue if nobody steps the world
+  static const std::size_t max_queued_commands = 1024;
+
+  StampedWheelSpeedCommand stamped_cmd;
+  stamped_cmd.stamp = common::Time(msg.header.stamp.sec, msg.header.stamp.nsec);
+  drive_model_.wheelSpeeds(msg.twist.linear.x, msg.twist.angular.z,
+                           stamped_cmd.command.wheel_speed[LEFT], stamped_cmd.command.wheel_speed[RIGHT]);
+  if (latency_tracer_)
+  {
+    stamped_cmd.command.trace = CommandLatencyTracer::tag(update_count_.load(std::memory_order_relaxed));
+  }
 
-  wheel_speed_cmd_[LEFT] = msg->linear.x - msg->angular.z * (wheel_sep_) / 2;
-  wheel_speed_cmd_[RIGHT] = msg->linear.x + msg->angular.z * (wheel_sep_) / 2;
+  boost::mutex::scoped_lock lock(stamped_cmd_mutex_);
+  if (stamped_cmds_.size() >= max_queued_commands)
+  {
+    ROS_WARN_STREAM_THROTTLE(1.0, "Too many queued velocity commands, dropping the new one. [" << node_name_ << "]");
+    return;
+  }
+  // after all commands with the same or an earlier stamp, so ties are applied in arrival order
+  std::deque<StampedWheelSpeedCommand>::iterator it = stamped_cmds_.end();
+  while ((it != stamped_cmds_.begin()) && (stamped_cmd.stamp < (it - 1)->stamp))
+  {
+    --it;
+  }
+  stamped_cmds_.insert(it, stamped_cmd);
+}
+
+/*
+ * Apply all stamped commands that are due; the last one is in effect for this update
+ */
+void GazeboRosKobuki::applyStampedCommands(const common::Time& time_now)
+{
+  boost::mutex::scoped_lock lock(stamped_cmd_mutex_);
+  while (!stamped_cmds_.empty() && (stamped_cmds_.front().stamp <= time_now))
+  {
+    state_.last_cmd_vel_time = time_now;
+    state_.wheel_speed_cmd[LEFT] = stamped_cmds_.front().command.wheel_speed[LEFT];
+    state_.wheel_speed_cmd[RIGHT] = stamped_cmds_.front().command.wheel_speed[RIGHT];
+    if (latency_tracer_)
+    {
+      latency_tracer_->accept(stamped_cmds_.front().command.trace);
+    }
+    stamped_cmds_.pop_front();
+  }
+}
+
+/*
+ * Runs on the step spinner thread and blocks it until the world has advanced, the result is captured by the
+ * last of the requested updates
+ */
+bool GazeboRosKobuki::stepCB(kobuki_gazebo_plugins::StepN::Request &req,
+                             kobuki_gazebo_plugins::StepN::Response &res)
+{
+  if (req.steps == 0)
+  {
+    ROS_WARN_STREAM("Ignoring request to advance the world by zero steps. [" << node_name_ << "]");
+    return false;
+  }
+  WorldStepper::Result result = WorldStepper::instance().step(*world_, *this, req, res);
+  if (result == WorldStepper::BUSY)
+  {
+    ROS_WARN_STREAM("Rejecting the step request, another one is advancing the world. [" << node_name_ << "]");
+  }
+  return result == WorldStepper::STEPPED;
+}
+
+void GazeboRosKobuki::captureStepResult(const common::Time& time_now)
+{
+  // only this (the update) thread counts down, the WorldStepper sets the count before stepping
+  if ((step_updates_remaining_ == 0) || (--step_updates_remaining_ != 0))
+  {
+    return;
+  }
+  boost::mutex::scoped_lock lock(step_mutex_);
+  step_result_->sim_time = ros::Time(time_now.sec, time_now.nsec);
+  fillOdometry(step_result_->odom);
+  fillIMU(step_result_->imu);
+  fillSensorState(step_result_->sensors);
 }
 
 void GazeboRosKobuki::resetOdomCB(const std_msgs::EmptyConstPtr &msg)
 {
-  odom_pose_[0] = 0.0;
-  odom_pose_[1] = 0.0;
-  odom_pose_[2] = 0.0;
+  odom_reset_requested_ = true;
 }
 
 // Register this plugin with the simulator
@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2013, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "kobuki_gazebo_plugins/gazebo_ros_kobuki_fleet.h"
+#include "kobuki_gazebo_plugins/kobuki_fleet.h"
+#include "kobuki_gazebo_plugins/world_stepper.h"
+
+namespace gazebo
+{
+
+GazeboRosKobukiFleet::GazeboRosKobukiFleet() : started_(false) {}
+
+GazeboRosKobukiFleet::~GazeboRosKobukiFleet()
+{
+  // waits for a step request in progress
+  if (nh_)
+  {
+    nh_->shutdown();
+  }
+  if (started_)
+  {
+    KobukiFleet::instance().stop();
+  }
+}
+
+void GazeboRosKobukiFleet::Load(physics::WorldPtr world, sdf::ElementPtr sdf)
+{
+  if (!world)
+  {
+    gzerr << "Invalid world pointer, Kobuki fleet manager not started.\n";
+    return;
+  }
+  // optionally process the robots on worker threads, in addition to Gazebo's update thread
+  int worker_threads = 0;
+  if (sdf->HasElement("worker_threads"))
+  {
+    worker_threads = sdf->GetElement("worker_threads")->Get<int>();
+  }
+  if (worker_threads < 0)
+  {
+    gzwarn << "Invalid number of worker threads (" << worker_threads << "), using none.\n";
+    worker_threads = 0;
+  }
+  started_ = KobukiFleet::instance().start(world, worker_threads);
+  // optionally send the odom transforms of all robots in one tf message
+  bool batch_tf = false;
+  if (sdf->HasElement("batch_tf"))
+  {
+    batch_tf = sdf->GetElement("batch_tf")->Get<bool>();
+  }
+  if (started_ && batch_tf)
+  {
+    double tf_rate = 0.0;
+    if (sdf->HasElement("tf_rate"))
+    {
+      tf_rate = sdf->GetElement("tf_rate")->Get<double>();
+    }
+    KobukiFleet::instance().batchTransforms(tf_rate);
+  }
+  // optionally advance the world for all robots in lockstep mode at once
+  bool lockstep = false;
+  if (sdf->HasElement("lockstep"))
+  {
+    lockstep = sdf->GetElement("lockstep")->Get<bool>();
+  }
+  if (lockstep)
+  {
+    if (!ros::isInitialized())
+    {
+      gzerr << "Can't advertise the Kobuki fleet's step_n service without a ROS node.\n";
+      return;
+    }
+    world_ = world;
+    world_->SetPaused(true);
+    ros_resources_ = RosResources::shared();
+    nh_.reset(new ros::NodeHandle("kobuki_fleet"));
+    nh_->setCallbackQueue(&ros_resources_->stepQueue());
+    step_service_ = nh_->advertiseService("step_n", &GazeboRosKobukiFleet::stepCB, this);
+    ros_resources_->startStepSpinner();
+    gzdbg << "Kobuki fleet lockstep mode: paused the world, advance it through kobuki_fleet/step_n.\n";
+  }
+}
+
+/*
+ * Runs on the step spinner thread and blocks it until the world has advanced
+ */
+bool GazeboRosKobukiFleet::stepCB(kobuki_gazebo_plugins::StepFleet::Request& req,
+                                  kobuki_gazebo_plugins::StepFleet::Response& res)
+{
+  WorldStepper::Result result = WorldStepper::instance().step(*world_, req, res);
+  if (result == WorldStepper::BUSY)
+  {
+    gzwarn << "Rejecting the Kobuki fleet's step request, another one is advancing the world.\n";
+  }
+  else if (result == WorldStepper::FAILED)
+  {
+    gzwarn << "The Kobuki fleet's step request failed (zero steps, unknown command robots, or the world stopped).\n";
+  }
+  return result == WorldStepper::STEPPED;
+}
+
+// Register this plugin with the simulator
+GZ_REGISTER_WORLD_PLUGIN(GazeboRosKobukiFleet);
+
+} // namespace gazebo
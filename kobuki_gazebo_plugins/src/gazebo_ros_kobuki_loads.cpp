@@ -34,6 +34,7 @@
  */
 
 #include "kobuki_gazebo_plugins/gazebo_ros_kobuki.h"
+#include "kobuki_gazebo_plugins/memory_usage.h"
 
 namespace gazebo
 {
@@ -50,26 +51,8 @@ void GazeboRosKobuki::prepareMotorPower() {
  */
 bool GazeboRosKobuki::prepareJointState()
 {
-  if (sdf_->HasElement("left_wheel_joint_name"))
-  {
-    left_wheel_joint_name_ = sdf_->GetElement("left_wheel_joint_name")->Get<std::string>();
-  }
-  else
-  {
-    ROS_ERROR_STREAM("Couldn't find left wheel joint in the model description!"
-                     << " Did you specify the correct joint name?" << " [" << node_name_ <<"]");
-    return false;
-  }
-  if (sdf_->HasElement("right_wheel_joint_name"))
-  {
-    right_wheel_joint_name_ = sdf_->GetElement("right_wheel_joint_name")->Get<std::string>();
-  }
-  else
-  {
-    ROS_ERROR_STREAM("Couldn't find right wheel joint in the model description!"
-                     << " Did you specify the correct joint name?" << " [" << node_name_ <<"]");
-    return false;
-  }
+  left_wheel_joint_name_ = config_->left_wheel_joint_name;
+  right_wheel_joint_name_ = config_->right_wheel_joint_name;
   joints_[LEFT] = model_->GetJoint(left_wheel_joint_name_);
   joints_[RIGHT] = model_->GetJoint(right_wheel_joint_name_);
   if (!joints_[LEFT] || !joints_[RIGHT])
@@ -77,7 +60,6 @@ bool GazeboRosKobuki::prepareJointState()
     ROS_ERROR_STREAM("Couldn't find specified wheel joints in the model! [" << node_name_ <<"]");
     return false;
   }
-  joint_state_.header.frame_id = "Joint States";
   joint_state_.name.push_back(left_wheel_joint_name_);
   joint_state_.position.push_back(0);
   joint_state_.velocity.push_back(0);
@@ -95,89 +77,195 @@ bool GazeboRosKobuki::prepareJointState()
  */
 void GazeboRosKobuki::preparePublishTf()
 {
-  if (sdf_->HasElement("publish_tf"))
-  {
-    publish_tf_ = sdf_->GetElement("publish_tf")->Get<bool>();
-    if (publish_tf_)
-    {
-      ROS_INFO_STREAM("Will publish tf." << " [" << node_name_ <<"]");
-    }
-    else
-    {
-      ROS_INFO_STREAM("Won't publish tf." << " [" << node_name_ <<"]");
-    }
-  }
-  else
+  state_.publish_tf = config_->publish_tf;
+  if (!config_->publish_tf_given)
   {
-    publish_tf_ = false;
     ROS_INFO_STREAM("Couldn't find the 'publish tf' parameter in the model description."
                      << " Won't publish tf." << " [" << node_name_ <<"]");
   }
-}
-
-bool GazeboRosKobuki::prepareWheelAndTorque()
-{
-  if (sdf_->HasElement("wheel_separation"))
+  else if (state_.publish_tf)
   {
-    wheel_sep_ = sdf_->GetElement("wheel_separation")->Get<double>();
+    ROS_INFO_STREAM("Will publish tf." << " [" << node_name_ <<"]");
   }
   else
   {
-    ROS_ERROR_STREAM("Couldn't find the wheel separation parameter in the model description!"
-                     << " Did you specify it?" << " [" << node_name_ <<"]");
-    return false;
+    ROS_INFO_STREAM("Won't publish tf." << " [" << node_name_ <<"]");
   }
-  if (sdf_->HasElement("wheel_diameter"))
+  tf_min_translation_ = config_->tf_min_translation;
+  tf_min_rotation_ = config_->tf_min_rotation;
+  if (state_.publish_tf && ((tf_min_translation_ > 0.0) || (tf_min_rotation_ > 0.0)))
   {
-    wheel_diam_ = sdf_->GetElement("wheel_diameter")->Get<double>();
+    ROS_INFO_STREAM("Will send the odom transform only after moving more than " << tf_min_translation_
+                    << " m or turning more than " << tf_min_rotation_ << " rad." << " [" << node_name_ <<"]");
   }
-  else
-  {
-    ROS_ERROR_STREAM("Couldn't find the wheel diameter parameter in the model description!"
-                     << " Did you specify it?" << " [" << node_name_ <<"]");
-    return false;
+}
+
+/*
+ * Prepare the publishing rates of the joint state, odometry, IMU and tf streams
+ */
+void GazeboRosKobuki::preparePublishRates()
+{
+  preparePublishRate("joint_state_rate", config_->joint_state_rate, joint_state_schedule_);
+  preparePublishRate("odom_rate", config_->odom_rate, odom_schedule_);
+  preparePublishRate("imu_rate", config_->imu_rate, imu_schedule_);
+  preparePublishRate("tf_rate", config_->tf_rate, tf_schedule_);
+
+  heartbeat_period_ = (config_->heartbeat_rate > 0.0) ? 1.0 / config_->heartbeat_rate : 0.0;
+  // in the order of the values the update passes to the filters
+  const double joint_state_min_change[4] = {config_->joint_state_min_position_change,
+                                            config_->joint_state_min_position_change,
+                                            config_->joint_state_min_velocity_change,
+                                            config_->joint_state_min_velocity_change};
+  const double odom_min_change[5] = {config_->odom_min_position_change, config_->odom_min_position_change,
+                                     config_->odom_min_orientation_change, config_->odom_min_linear_velocity_change,
+                                     config_->odom_min_angular_velocity_change};
+  const double imu_min_change[9] = {config_->imu_min_orientation_change, config_->imu_min_orientation_change,
+                                    config_->imu_min_orientation_change, config_->imu_min_angular_velocity_change,
+                                    config_->imu_min_angular_velocity_change, config_->imu_min_angular_velocity_change,
+                                    config_->imu_min_acceleration_change, config_->imu_min_acceleration_change,
+                                    config_->imu_min_acceleration_change};
+  joint_state_filter_.configure(joint_state_min_change, heartbeat_period_);
+  odom_filter_.configure(odom_min_change, heartbeat_period_);
+  imu_filter_.configure(imu_min_change, heartbeat_period_);
+  if (joint_state_filter_.enabled())
+  {
+    ROS_INFO_STREAM("Will only publish joint states once a position changed by more than "
+                    << config_->joint_state_min_position_change << " rad or a velocity by more than "
+                    << config_->joint_state_min_velocity_change << " rad/s." << " [" << node_name_ <<"]");
+  }
+  if (odom_filter_.enabled())
+  {
+    ROS_INFO_STREAM("Will only publish odometry once the position changed by more than "
+                    << config_->odom_min_position_change << " m, the heading by more than "
+                    << config_->odom_min_orientation_change << " rad or the velocity by more than "
+                    << config_->odom_min_linear_velocity_change << " m/s or "
+                    << config_->odom_min_angular_velocity_change << " rad/s." << " [" << node_name_ <<"]");
+  }
+  if (imu_filter_.enabled())
+  {
+    ROS_INFO_STREAM("Will only publish IMU data once the orientation changed by more than "
+                    << config_->imu_min_orientation_change << " rad, the angular velocity by more than "
+                    << config_->imu_min_angular_velocity_change << " rad/s or the acceleration by more than "
+                    << config_->imu_min_acceleration_change << " m/s^2." << " [" << node_name_ <<"]");
+  }
+  if (joint_state_filter_.enabled() || odom_filter_.enabled() || imu_filter_.enabled())
+  {
+    ROS_INFO_STREAM("Unchanged streams are published at " << config_->heartbeat_rate << " Hz (zero for never)."
+                    << " [" << node_name_ <<"]");
   }
-  if (sdf_->HasElement("torque"))
+}
+
+void GazeboRosKobuki::preparePublishRate(const std::string& element_name, double rate, PublishSchedule& schedule)
+{
+  schedule.setRate(rate);
+  if (schedule.everyUpdate())
   {
-    torque_ = sdf_->GetElement("torque")->Get<double>();
+    ROS_INFO_STREAM("Will publish on every update (" << element_name << ")." << " [" << node_name_ <<"]");
   }
   else
   {
-    ROS_ERROR_STREAM("Couldn't find the torque parameter in the model description!"
-                     << " Did you specify it?" << " [" << node_name_ <<"]");
-    return false;
+    ROS_INFO_STREAM("Will publish at " << rate << " Hz (" << element_name << ")." << " [" << node_name_ <<"]");
+  }
+}
+
+void GazeboRosKobuki::prepareWheelAndTorque()
+{
+  wheel_sep_ = config_->wheel_separation;
+  wheel_diam_ = config_->wheel_diameter;
+  drive_model_ = DiffDriveModel<WheelGeometry>(WheelGeometry(wheel_sep_, wheel_diam_),
+                                               drive_model_.integrator());
+  torque_ = config_->torque;
+  state_.kinematic = config_->kinematic;
+  if (state_.kinematic)
+  {
+    ROS_INFO_STREAM("Will move the model kinematically along the commanded path, the wheels aren't driven."
+                    << " [" << node_name_ <<"]");
+    return;
+  }
+  state_.joint_motors = config_->joint_motors;
+  if (state_.joint_motors)
+  {
+    // the motors hold their target velocity with up to fmax, so they are only written when the command changes
+    for (unsigned int side = LEFT; side <= RIGHT; ++side)
+    {
+      if (!joints_[side]->SetParam("vel", 0, 0.0))
+      {
+        ROS_WARN_STREAM("The physics engine doesn't support joint motors, falling back to the 'velocity' wheel"
+                        << " actuation." << " [" << node_name_ <<"]");
+        state_.joint_motors = false;
+        break;
+      }
+    }
+  }
+  if (state_.joint_motors)
+  {
+    setJointMotorForce(motors_enabled_ ? torque_ : 0.0);
+    ROS_INFO_STREAM("Will drive the wheels through joint motors with a max. torque of " << torque_ << " Nm."
+                    << " [" << node_name_ <<"]");
   }
-  return true;
 }
 
 void GazeboRosKobuki::prepareOdom()
 {
-  odom_pose_[0] = 0.0;
-  odom_pose_[1] = 0.0;
-  odom_pose_[2] = 0.0;
+  static const char* integrator_names[] = {"euler", "midpoint", "arc"};
+  state_.odom_pose[0] = 0.0;
+  state_.odom_pose[1] = 0.0;
+  state_.odom_pose[2] = 0.0;
+
+  drive_model_.setIntegrator(config_->odom_integrator);
+  ROS_INFO_STREAM("Will integrate odometry with the '" << integrator_names[config_->odom_integrator] << "' integrator."
+                  << " [" << node_name_ <<"]");
 }
 
 /*
  * Prepare receiving velocity commands
  */
-bool GazeboRosKobuki::prepareVelocityCommand()
+void GazeboRosKobuki::prepareVelocityCommand()
 {
-  if (sdf_->HasElement("velocity_command_timeout"))
+  state_.cmd_vel_timeout = config_->velocity_command_timeout;
+  state_.last_cmd_vel_time = api::simTime(*world_);
+
+  velocity_smoother_.setLimits(config_->wheel_acceleration_limit, config_->wheel_deceleration_limit);
+  if ((config_->wheel_acceleration_limit > 0.0) || (config_->wheel_deceleration_limit > 0.0))
   {
-    cmd_vel_timeout_ = sdf_->GetElement("velocity_command_timeout")->Get<double>();
+    ROS_INFO_STREAM("Will limit the wheel acceleration to " << config_->wheel_acceleration_limit
+                    << " m/s^2 and the deceleration to " << config_->wheel_deceleration_limit
+                    << " m/s^2 (zero for no limit)." << " [" << node_name_ <<"]");
   }
-  else
+  joint_velocity_tolerance_ = config_->joint_velocity_tolerance;
+  if (joint_velocity_tolerance_ > 0.0)
   {
-    ROS_ERROR_STREAM("Couldn't find the wheel separation parameter in the model description!"
-                     << " Did you specify it?" << " [" << node_name_ <<"]");
-    return false;
+    ROS_INFO_STREAM("Will rewrite steady wheel joint velocities only when off by more than "
+                    << joint_velocity_tolerance_ << " rad/s." << " [" << node_name_ <<"]");
   }
-  #if GAZEBO_MAJOR_VERSION >= 9
-    last_cmd_vel_time_ = world_->SimTime();
-  #else
-    last_cmd_vel_time_ = world_->GetSimTime();
-  #endif
-  return true;
+}
+
+/*
+ * Look a sensor up by its scoped name (world::model::link::sensor) among the sensors of the model's links, so
+ * robots with equally named sensors don't get each other's
+ * @param link set to the link the sensor is attached to, if given
+ */
+sensors::SensorPtr GazeboRosKobuki::findSensor(const std::string& name, physics::LinkPtr* link) const
+{
+  const std::string suffix = "::" + name;
+  for (const physics::LinkPtr& sensor_link : model_->GetLinks())
+  {
+    for (unsigned int i = 0; i < sensor_link->GetSensorCount(); ++i)
+    {
+      std::string scoped_name = sensor_link->GetSensorName(i);
+      if ((scoped_name == name) ||
+          ((scoped_name.size() > suffix.size()) &&
+           (scoped_name.compare(scoped_name.size() - suffix.size(), suffix.size(), suffix) == 0)))
+      {
+        if (link)
+        {
+          *link = sensor_link;
+        }
+        return sensors::get_sensor(scoped_name);
+      }
+    }
+  }
+  return sensors::SensorPtr();
 }
 
 bool GazeboRosKobuki::prepareCliffSensor()
@@ -185,71 +273,27 @@ bool GazeboRosKobuki::prepareCliffSensor()
   /*
    * Prepare cliff sensors
    */
-  std::string cliff_sensor_left_name, cliff_sensor_center_name, cliff_sensor_right_name;
-  if (sdf_->HasElement("cliff_sensor_left_name"))
-  {
-    cliff_sensor_left_name = sdf_->GetElement("cliff_sensor_left_name")->Get<std::string>();
-  }
-  else
-  {
-    ROS_ERROR_STREAM("Couldn't find the name of left cliff sensor in the model description!"
-                     << " Did you specify it?" << " [" << node_name_ <<"]");
-    return false;
-  }
-  if (sdf_->HasElement("cliff_sensor_center_name"))
-  {
-    cliff_sensor_center_name = sdf_->GetElement("cliff_sensor_center_name")->Get<std::string>();
-  }
-  else
-  {
-    ROS_ERROR_STREAM("Couldn't find the name of frontal cliff sensor in the model description!"
-                     << " Did you specify it?" << " [" << node_name_ <<"]");
-    return false;
-  }
-  if (sdf_->HasElement("cliff_sensor_right_name"))
-  {
-    cliff_sensor_right_name = sdf_->GetElement("cliff_sensor_right_name")->Get<std::string>();
-  }
-  else
-  {
-    ROS_ERROR_STREAM("Couldn't find the name of right cliff sensor in the model description!"
-                     << " Did you specify it?" << " [" << node_name_ <<"]");
-    return false;
-  }
-  cliff_sensor_left_ = std::dynamic_pointer_cast<sensors::RaySensor>(
-                       sensors::SensorManager::Instance()->GetSensor(cliff_sensor_left_name));
-  cliff_sensor_center_ = std::dynamic_pointer_cast<sensors::RaySensor>(
-                        sensors::SensorManager::Instance()->GetSensor(cliff_sensor_center_name));
-  cliff_sensor_right_ = std::dynamic_pointer_cast<sensors::RaySensor>(
-                        sensors::SensorManager::Instance()->GetSensor(cliff_sensor_right_name));
-  if (!cliff_sensor_left_)
-  {
-    ROS_ERROR_STREAM("Couldn't find the left cliff sensor in the model! [" << node_name_ <<"]");
-    return false;
-  }
-  if (!cliff_sensor_center_)
-  {
-    ROS_ERROR_STREAM("Couldn't find the center cliff sensor in the model! [" << node_name_ <<"]");
-    return false;
-  }
-  if (!cliff_sensor_right_)
-  {
-    ROS_ERROR_STREAM("Couldn't find the right cliff sensor in the model! [" << node_name_ <<"]");
-    return false;
-  }
-  if (sdf_->HasElement("cliff_detection_threshold"))
+  static const char* sensor_labels[SENSOR_COUNT] = {"left", "center", "right"};
+  for (unsigned int i = 0; i < SENSOR_COUNT; ++i)
   {
-    cliff_detection_threshold_ = sdf_->GetElement("cliff_detection_threshold")->Get<double>();
+    cliff_sensors_[i] = std::dynamic_pointer_cast<sensors::RaySensor>(findSensor(config_->cliff_sensor_names[i],
+                                                                                 &cliff_links_[i]));
+    if (!cliff_sensors_[i])
+    {
+      ROS_ERROR_STREAM("Couldn't find the " << sensor_labels[i] << " cliff sensor in the model! ["
+                       << node_name_ <<"]");
+      return false;
+    }
   }
-  else
+  state_.cliff_detection_threshold = config_->cliff_detection_threshold;
+  state_.cliff_detection_hysteresis = config_->cliff_detection_hysteresis;
+  state_.skip_unchanged_sensors = config_->skip_unchanged_sensors;
+  state_.publish_sensor_state = (config_->sensor_state_rate > 0.0);
+  sensor_state_schedule_.setRate(config_->sensor_state_rate);
+  for (unsigned int i = 0; i < SENSOR_COUNT; ++i)
   {
-    ROS_ERROR_STREAM("Couldn't find the cliff detection threshold parameter in the model description!"
-                     << " Did you specify it?" << " [" << node_name_ <<"]");
-    return false;
+    cliff_sensors_[i]->SetActive(true);
   }
-  cliff_sensor_left_->SetActive(true);
-  cliff_sensor_center_->SetActive(true);
-  cliff_sensor_right_->SetActive(true);
 
   return true;
 }
@@ -260,24 +304,38 @@ bool GazeboRosKobuki::prepareCliffSensor()
  */
 bool GazeboRosKobuki::prepareBumper()
 {
-  std::string bumper_name;
-  if (sdf_->HasElement("bumper_name"))
-  {
-    bumper_name = sdf_->GetElement("bumper_name")->Get<std::string>();
-  }
-  else
-  {
-    ROS_ERROR_STREAM("Couldn't find the name of bumper sensor in the model description!"
-                     << " Did you specify it?" << " [" << node_name_ <<"]");
-    return false;
-  }
-  bumper_ = std::dynamic_pointer_cast<sensors::ContactSensor>(
-            sensors::SensorManager::Instance()->GetSensor(bumper_name));
+  bumper_ = std::dynamic_pointer_cast<sensors::ContactSensor>(findSensor(config_->bumper_name));
   if (!bumper_)
   {
     ROS_ERROR_STREAM("Couldn't find the bumpers in the model! [" << node_name_ <<"]");
     return false;
   }
+  bumper_sectors_ = config_->bumper_sectors;
+  state_.bumper_physics_contacts = config_->bumper_physics_contacts;
+  if (state_.bumper_physics_contacts)
+  {
+    bumper_collisions_.clear();
+    for (unsigned int i = 0; i < bumper_->GetCollisionCount(); ++i)
+    {
+      physics::CollisionPtr collision = boost::dynamic_pointer_cast<physics::Collision>(
+                                        api::entityByName(*world_, bumper_->GetCollisionName(i)));
+      if (collision)
+      {
+        bumper_collisions_.push_back(collision);
+      }
+    }
+    if (bumper_collisions_.empty())
+    {
+      ROS_WARN_STREAM("Couldn't find the bumper's collisions, reading the contacts from the sensor instead."
+                      << " [" << node_name_ <<"]");
+      state_.bumper_physics_contacts = false;
+    }
+    else
+    {
+      ROS_INFO_STREAM("Will read the bumper contacts from the physics engine." << " [" << node_name_ <<"]");
+    }
+  }
+  // also when reading from the physics engine: the sensor's contact filter keeps the bumper's contacts
   bumper_->SetActive(true);
   return true;
 }
@@ -287,25 +345,7 @@ bool GazeboRosKobuki::prepareBumper()
  */
 bool GazeboRosKobuki::prepareIMU()
 {
-  std::string imu_name;
-  if (sdf_->HasElement("imu_name"))
-  {
-  imu_name = sdf_->GetElement("imu_name")->Get<std::string>();
-  }
-  else
-  {
-    ROS_ERROR_STREAM("Couldn't find the name of IMU sensor in the model description!"
-                     << " Did you specify it?" << " [" << node_name_ <<"]");
-    return false;
-  }
-  #if GAZEBO_MAJOR_VERSION >= 9
-    imu_ = std::dynamic_pointer_cast<sensors::ImuSensor>(
-            sensors::get_sensor(world_->Name()+"::"+node_name_+"::base_footprint::"+imu_name));
-  #else
-    imu_ = std::dynamic_pointer_cast<sensors::ImuSensor>(
-            sensors::get_sensor(world_->GetName()+"::"+node_name_+"::base_footprint::"+imu_name));
-
-  #endif
+  imu_ = std::dynamic_pointer_cast<sensors::ImuSensor>(findSensor(config_->imu_name));
   if (!imu_)
   {
     ROS_ERROR_STREAM("Couldn't find the IMU in the model! [" << node_name_ <<"]");
@@ -315,11 +355,117 @@ bool GazeboRosKobuki::prepareIMU()
   return true;
 }
 
+/*
+ * Prepare timing the update stages, published as diagnostics
+ */
+void GazeboRosKobuki::prepareTimingDiagnostics()
+{
+  double rate = config_->timing_diagnostics_rate;
+  if (rate <= 0.0)
+  {
+    return;
+  }
+  diagnostics_schedule_.setRate(rate);
+  profiler_.reset(new StageProfiler(STAGE_COUNT));
+  diagnostics_.reset(new diagnostic_msgs::DiagnosticArray());
+
+  static const char* stage_names[STAGE_COUNT] = {"commands", "sensors", "joint_state", "odometry", "imu",
+                                                 "velocity_commands", "cliff", "bumper", "core_sim", "record",
+                                                 "shared_memory", "telemetry"};
+  static const char* value_keys[] = {"updates", "min [us]", "mean [us]", "p99 [us]", "max [us]"};
+  diagnostics_->status.resize(STAGE_COUNT);
+  for (std::size_t i = 0; i < STAGE_COUNT; ++i)
+  {
+    diagnostic_msgs::DiagnosticStatus& status = diagnostics_->status[i];
+    status.level = diagnostic_msgs::DiagnosticStatus::OK;
+    status.name = node_name_ + ": update stage " + stage_names[i];
+    status.hardware_id = node_name_;
+    status.message = "Time spent per update";
+    status.values.resize(5);
+    for (std::size_t j = 0; j < status.values.size(); ++j)
+    {
+      status.values[j].key = value_keys[j];
+    }
+  }
+  diagnostic_msgs::KeyValue joint_writes;
+  joint_writes.key = "joint writes";
+  diagnostics_->status[STAGE_VELOCITY_COMMANDS].values.push_back(joint_writes);
+  joint_writes_ = 0;
+  ROS_INFO_STREAM("Will publish timing diagnostics at " << rate << " Hz." << " [" << node_name_ <<"]");
+}
+
+/*
+ * Trace the velocity commands from their arrival until they are applied and until odometry reflects them,
+ * reported as two more statuses of the timing diagnostics
+ */
+void GazeboRosKobuki::prepareLatencyTracing()
+{
+  if (!config_->latency_tracing)
+  {
+    return;
+  }
+  if (!profiler_)
+  {
+    ROS_WARN_STREAM("Latency tracing is reported with the timing diagnostics, set timing_diagnostics_rate to"
+                    << " enable it." << " [" << node_name_ <<"]");
+    return;
+  }
+  latency_tracer_.reset(new CommandLatencyTracer());
+  static const char* milestone_names[CommandLatencyTracer::MILESTONE_COUNT] = {"applied", "odometry"};
+  static const char* value_keys[] = {"commands", "min [us]", "mean [us]", "p99 [us]", "max [us]",
+                                     "mean [updates]", "max [updates]"};
+  for (std::size_t i = 0; i < CommandLatencyTracer::MILESTONE_COUNT; ++i)
+  {
+    diagnostic_msgs::DiagnosticStatus status;
+    status.level = diagnostic_msgs::DiagnosticStatus::OK;
+    status.name = node_name_ + ": command latency " + milestone_names[i];
+    status.hardware_id = node_name_;
+    status.message = "Time from a velocity command's arrival";
+    status.values.resize(7);
+    for (std::size_t j = 0; j < status.values.size(); ++j)
+    {
+      status.values[j].key = value_keys[j];
+    }
+    diagnostics_->status.push_back(status);
+  }
+  ROS_INFO_STREAM("Will trace the latency of the velocity commands." << " [" << node_name_ <<"]");
+}
+
 void GazeboRosKobuki::setupRosApi(std::string& model_name)
 {
   std::string base_prefix;
   gazebo_ros_->node()->param("base_prefix", base_prefix, std::string("mobile_base"));
 
+  // Serve our subscriptions from the plugin's own (or the shared) queue instead of the global one
+  if (config_->share_ros_resources)
+  {
+    ros_resources_ = RosResources::shared();
+    ROS_INFO_STREAM("Will share the callback queue and the tf broadcaster with the other instances."
+                    << " [" << node_name_ <<"]");
+  }
+  else
+  {
+    ros_resources_.reset(new RosResources());
+  }
+  gazebo_ros_->node()->setCallbackQueue(&ros_resources_->callbackQueue());
+
+  // The tf prefix is fixed for the lifetime of the GazeboRos node, so the frames only need resolving once
+  base_link_frame_ = gazebo_ros_->resolveTF("base_link");
+  odom_frame_ = gazebo_ros_->resolveTF("odom");
+  base_frame_ = gazebo_ros_->resolveTF("base_footprint");
+  prepareMessages();
+  if (state_.publish_tf && config_->tf2)
+  {
+    tf2_broadcaster_ = &ros_resources_->tf2Broadcaster();
+    ROS_INFO_STREAM("Will broadcast tf through tf2_ros." << " [" << node_name_ <<"]");
+  }
+  else if (state_.publish_tf)
+  {
+    tf_broadcaster_ = &ros_resources_->tfBroadcaster();
+  }
+  // drives the lazy sensor activation (see updateSensorActivation())
+  ros::SubscriberStatusCallback sensor_subscribers_cb = boost::bind(&GazeboRosKobuki::sensorSubscribersCB, this, _1);
+
   // Public topics
 
   // joint_states
@@ -349,19 +495,456 @@ void GazeboRosKobuki::setupRosApi(std::string& model_name)
   cmd_vel_sub_ = gazebo_ros_->node()->subscribe(cmd_vel_topic, 100, &GazeboRosKobuki::cmdVelCB, this);
   ROS_INFO("%s: Try to subscribe to %s!", gazebo_ros_->info(), cmd_vel_topic.c_str());
 
+  // combined robot state
+  if (state_.publish_core_sim)
+  {
+    std::string core_sim_topic = base_prefix + "/sensors/core_sim";
+    core_sim_pub_ = gazebo_ros_->node()->advertise<kobuki_gazebo_plugins::CoreSim>(core_sim_topic, 1,
+                                                                                   sensor_subscribers_cb,
+                                                                                   sensor_subscribers_cb);
+    ROS_INFO("%s: Advertise CoreSim[%s]!", gazebo_ros_->info(), core_sim_topic.c_str());
+  }
+
+  // decimated telemetry
+  if (state_.publish_telemetry)
+  {
+    std::string telemetry_topic = base_prefix + "/sensors/telemetry";
+    telemetry_pub_ = gazebo_ros_->node()->advertise<kobuki_gazebo_plugins::Telemetry>(telemetry_topic, 1);
+    ROS_INFO("%s: Advertise Telemetry[%s]!", gazebo_ros_->info(), telemetry_topic.c_str());
+  }
+
+  // lockstep mode
+  if (state_.lockstep)
+  {
+    std::string cmd_vel_stamped_topic = base_prefix + "/commands/velocity_stamped";
+    cmd_vel_stamped_sub_ = gazebo_ros_->node()->subscribe(cmd_vel_stamped_topic, 100,
+                                                          &GazeboRosKobuki::cmdVelStampedCB, this);
+    ROS_INFO("%s: Try to subscribe to %s!", gazebo_ros_->info(), cmd_vel_stamped_topic.c_str());
+
+    // served on the step queue, as it blocks until the world has advanced
+    std::string step_service = base_prefix + "/step_n";
+    step_nh_.reset(new ros::NodeHandle(*gazebo_ros_->node()));
+    step_nh_->setCallbackQueue(&ros_resources_->stepQueue());
+    step_service_ = step_nh_->advertiseService(step_service, &GazeboRosKobuki::stepCB, this);
+    ROS_INFO("%s: Advertise service %s!", gazebo_ros_->info(), step_service.c_str());
+  }
+
   // cliff
   std::string cliff_topic = base_prefix + "/events/cliff";
-  cliff_event_pub_ = gazebo_ros_->node()->advertise<kobuki_msgs::CliffEvent>(cliff_topic, 1);
+  cliff_event_pub_ = gazebo_ros_->node()->advertise<kobuki_msgs::CliffEvent>(cliff_topic, 1,
+                                                                        sensor_subscribers_cb, sensor_subscribers_cb);
   ROS_INFO("%s: Advertise Cliff[%s]!", gazebo_ros_->info(), cliff_topic.c_str());
 
+  // raw cliff and bumper readings
+  if (state_.publish_sensor_state)
+  {
+    std::string sensor_state_topic = base_prefix + "/sensors/core";
+    sensor_state_pub_ = gazebo_ros_->node()->advertise<kobuki_msgs::SensorState>(sensor_state_topic, 1,
+                                                                                sensor_subscribers_cb,
+                                                                                sensor_subscribers_cb);
+    ROS_INFO("%s: Advertise SensorState[%s]!", gazebo_ros_->info(), sensor_state_topic.c_str());
+  }
+
   // bumper
   std::string bumper_topic = base_prefix + "/events/bumper";
-  bumper_event_pub_ = gazebo_ros_->node()->advertise<kobuki_msgs::BumperEvent>(bumper_topic, 1);
+  bumper_event_pub_ = gazebo_ros_->node()->advertise<kobuki_msgs::BumperEvent>(bumper_topic, 1,
+                                                                          sensor_subscribers_cb, sensor_subscribers_cb);
   ROS_INFO("%s: Advertise Bumper[%s]!", gazebo_ros_->info(), bumper_topic.c_str());
 
   // IMU
   std::string imu_topic = base_prefix + "/sensors/imu_data";
   imu_pub_ = gazebo_ros_->node()->advertise<sensor_msgs::Imu>(imu_topic, 1);
   ROS_INFO("%s: Advertise IMU[%s]!", gazebo_ros_->info(), imu_topic.c_str());
+
+  // timing diagnostics
+  if (profiler_)
+  {
+    std::string diagnostics_topic = "/diagnostics";
+    diagnostics_pub_ = gazebo_ros_->node()->advertise<diagnostic_msgs::DiagnosticArray>(diagnostics_topic, 1);
+    ROS_INFO("%s: Advertise Diagnostics[%s]!", gazebo_ros_->info(), diagnostics_topic.c_str());
+  }
+}
+
+/*
+ * Fill all message fields that don't change during the simulation, so the update path only writes
+ * the measurements
+ */
+void GazeboRosKobuki::prepareMessages()
+{
+  joint_state_.header.frame_id = base_link_frame_;
+
+  odom_.header.frame_id = odom_frame_;
+  odom_.child_frame_id = base_frame_;
+  odom_.pose.pose.position.z = 0;
+  odom_.pose.covariance[0]  = 0.1;
+  odom_.pose.covariance[7]  = 0.1;
+  odom_.pose.covariance[35] = 0.05;
+  odom_.pose.covariance[14] = 1e6;
+  odom_.pose.covariance[21] = 1e6;
+  odom_.pose.covariance[28] = 1e6;
+  odom_.twist.twist.linear.y = 0;
+  odom_.twist.twist.linear.z = 0;
+  odom_.twist.twist.angular.x = 0;
+  odom_.twist.twist.angular.y = 0;
+
+  odom_tf_.header.frame_id = odom_frame_;
+  odom_tf_.child_frame_id = base_frame_;
+  odom_tf_.transform.translation.z = 0;
+
+  imu_msg_.header.frame_id = base_link_frame_;
+  imu_msg_.orientation_covariance[0] = 1e6;
+  imu_msg_.orientation_covariance[4] = 1e6;
+  imu_msg_.orientation_covariance[8] = 0.05;
+  imu_msg_.angular_velocity_covariance[0] = 1e6;
+  imu_msg_.angular_velocity_covariance[4] = 1e6;
+  imu_msg_.angular_velocity_covariance[8] = 0.05;
+
+  // the rarely used messages only exist while their feature is enabled
+  if (core_sim_)
+  {
+    core_sim_->header.frame_id = odom_frame_;
+  }
+  if (telemetry_)
+  {
+    telemetry_->header.frame_id = odom_frame_;
+  }
+  if (step_result_)
+  {
+    step_result_->odom = odom_;
+    step_result_->imu = imu_msg_;
+  }
+}
+
+/*
+ * Lockstep mode: the world only advances through the step_n service
+ */
+void GazeboRosKobuki::prepareLockstep()
+{
+  state_.lockstep = config_->lockstep;
+  if (!state_.lockstep)
+  {
+    return;
+  }
+  step_result_.reset(new kobuki_gazebo_plugins::StepN::Response());
+  world_->SetPaused(true);
+  ROS_INFO_STREAM("Lockstep mode: paused the world, advance it through the step_n service."
+                  << " [" << node_name_ <<"]");
+}
+
+/*
+ * Combined robot state, published alone instead of the separate streams it bundles
+ */
+void GazeboRosKobuki::prepareCoreSim()
+{
+  double rate = config_->core_sim_rate;
+  if (rate <= 0.0)
+  {
+    return;
+  }
+  state_.publish_core_sim = true;
+  core_sim_.reset(new kobuki_gazebo_plugins::CoreSim());
+  core_sim_schedule_.setRate(rate);
+  ROS_INFO_STREAM("Will publish the combined robot state at " << rate << " Hz." << " [" << node_name_ <<"]");
+}
+
+/*
+ * Decimated telemetry for GUI tools, aggregated over the updates between two messages; and the simulated
+ * battery it (and the sensor state) reports
+ */
+void GazeboRosKobuki::prepareTelemetry()
+{
+  if (config_->battery_capacity > 0.0)
+  {
+    battery_.configure(config_->battery_capacity, config_->battery_base_current, config_->battery_motor_current);
+    ROS_INFO_STREAM("Will simulate a " << config_->battery_capacity << " Ah battery." << " [" << node_name_ <<"]");
+  }
+  double rate = config_->telemetry_rate;
+  if (rate <= 0.0)
+  {
+    return;
+  }
+  state_.publish_telemetry = true;
+  telemetry_.reset(new kobuki_gazebo_plugins::Telemetry());
+  telemetry_schedule_.setRate(rate);
+  telemetry_start_ = api::simTime(*world_);
+  ROS_INFO_STREAM("Will publish the decimated telemetry at " << rate << " Hz." << " [" << node_name_ <<"]");
+}
+
+/*
+ * Encoder and gyro noise models, all disabled unless configured
+ */
+void GazeboRosKobuki::prepareNoise()
+{
+  SensorNoiseParameters& parameters = config_->noise;
+  if (!parameters.seeded)
+  {
+    // FNV-1a of the scoped model name: differs between the robots of a world, same on every run
+    uint32_t hash = 2166136261u;
+    const std::string name = model_->GetScopedName();
+    for (std::size_t i = 0; i < name.size(); ++i)
+    {
+      hash = (hash ^ static_cast<unsigned char>(name[i])) * 16777619u;
+    }
+    parameters.seed = hash;
+  }
+  noise_model_.configure(parameters);
+  if (noise_model_.enabled())
+  {
+    ROS_INFO_STREAM("Will simulate sensor noise (encoder quantisation: " << parameters.encoder_quantisation
+                    << ", wheel slip: " << parameters.wheel_slip_stddev
+                    << ", gyro noise: " << parameters.gyro_noise_stddev
+                    << " rad/s, bias: " << parameters.gyro_bias
+                    << " rad/s, drift: " << parameters.gyro_drift_stddev << " rad/s/sqrt(s), seed: "
+                    << parameters.seed << (parameters.seeded ? ")." : " from the model name).")
+                    << " [" << node_name_ <<"]");
+  }
+}
+
+/*
+ * Recording of the state of every update to a memory-mapped ring file (see kobuki_state_replay)
+ */
+void GazeboRosKobuki::prepareRecorder()
+{
+  if (config_->record_file.empty())
+  {
+    return;
+  }
+  std::string record_file = config_->record_file;
+  for (std::size_t at = record_file.find("%s"); at != std::string::npos;
+       at = record_file.find("%s", at + node_name_.size()))
+  {
+    record_file.replace(at, 2, node_name_);
+  }
+  int capacity = config_->record_capacity;
+  if (!recorder_.create(record_file, capacity))
+  {
+    ROS_ERROR_STREAM("Couldn't create the record file '" << record_file << "' for " << capacity << " records"
+                     << " (another robot may record to it, put %s in the path for the model name)."
+                     << " Won't record." << " [" << node_name_ <<"]");
+    return;
+  }
+  ROS_INFO_STREAM("Will record the last " << capacity << " updates to '" << record_file << "'."
+                  << " [" << node_name_ <<"]");
+}
+
+/*
+ * Command and state interface for external processes through a POSIX shared memory segment
+ * (see shared_state_segment.h), shared by all robots of the world naming the same segment
+ */
+void GazeboRosKobuki::prepareSharedMemory()
+{
+  if (config_->shared_memory.empty())
+  {
+    return;
+  }
+  const std::string& name = config_->shared_memory;
+  shared_segment_ = SharedStateSegment::open(name, config_->shared_memory_capacity);
+  if (!shared_segment_)
+  {
+    ROS_ERROR_STREAM("Couldn't create the shared memory segment '" << name << "' for "
+                     << config_->shared_memory_capacity << " robots. Won't use it." << " [" << node_name_ <<"]");
+    return;
+  }
+  shared_slot_ = shared_segment_->claim(node_name_);
+  if (!shared_slot_)
+  {
+    ROS_ERROR_STREAM("All " << shared_segment_->capacity() << " slots of the shared memory segment '" << name
+                     << "' are taken. Won't use it." << " [" << node_name_ <<"]");
+    shared_segment_.reset();
+    return;
+  }
+  // take over commands written from now on only
+  uint32_t sequence = 0;
+  KobukiSharedCommand command;
+  shared_slot_->command.read(command, sequence);
+  shared_cmd_sequence_ = sequence;
+  ROS_INFO_STREAM("Will exchange state and commands through slot " << shared_segment_->index(shared_slot_)
+                  << " of the shared memory segment '" << name << "'." << " [" << node_name_ <<"]");
+}
+
+/*
+ * Prepare publishing the joint state, odometry and IMU messages as shared pointers from preallocated
+ * pools; in-process subscribers then receive them without serialization
+ */
+void GazeboRosKobuki::prepareMessagePools()
+{
+  if (!config_->intra_process_publishing)
+  {
+    return;
+  }
+  int pool_size = config_->message_pool_size;
+  // the member messages already hold all invariant fields (see prepareMessages)
+  joint_state_pool_.init(pool_size, joint_state_);
+  odom_pool_.init(pool_size, odom_);
+  imu_pool_.init(pool_size, imu_msg_);
+  if (state_.publish_core_sim)
+  {
+    core_sim_pool_.init(pool_size, *core_sim_);
+  }
+  ROS_INFO_STREAM("Will publish from message pools of size " << pool_size << "." << " [" << node_name_ <<"]");
+}
+
+/*
+ * Heap held by the messages' strings and variable-length arrays [bytes]
+ */
+static std::size_t heapUsage(const std_msgs::Header& header)
+{
+  return heapUsage(header.frame_id);
+}
+
+static std::size_t heapUsage(const sensor_msgs::JointState& msg)
+{
+  return heapUsage(msg.header) + heapUsage(msg.name) +
+         bufferUsage(msg.position) + bufferUsage(msg.velocity) + bufferUsage(msg.effort);
+}
+
+static std::size_t heapUsage(const nav_msgs::Odometry& msg)
+{
+  return heapUsage(msg.header) + heapUsage(msg.child_frame_id);
+}
+
+static std::size_t heapUsage(const geometry_msgs::TransformStamped& msg)
+{
+  return heapUsage(msg.header) + heapUsage(msg.child_frame_id);
+}
+
+static std::size_t heapUsage(const sensor_msgs::Imu& msg)
+{
+  return heapUsage(msg.header);
+}
+
+static std::size_t heapUsage(const kobuki_msgs::SensorState& msg)
+{
+  return heapUsage(msg.header) + bufferUsage(msg.bottom) + bufferUsage(msg.current) + bufferUsage(msg.analog_input);
+}
+
+static std::size_t heapUsage(const kobuki_gazebo_plugins::CoreSim& msg)
+{
+  return heapUsage(msg.header) + heapUsage(msg.sensors);
+}
+
+static std::size_t heapUsage(const kobuki_gazebo_plugins::Telemetry& msg)
+{
+  return heapUsage(msg.header);
+}
+
+static std::size_t heapUsage(const kobuki_gazebo_plugins::StepN::Response& msg)
+{
+  return heapUsage(msg.odom) + heapUsage(msg.imu) + heapUsage(msg.sensors);
+}
+
+static std::size_t heapUsage(const diagnostic_msgs::DiagnosticArray& msg)
+{
+  std::size_t usage = heapUsage(msg.header) + bufferUsage(msg.status);
+  for (std::size_t i = 0; i < msg.status.size(); ++i)
+  {
+    const diagnostic_msgs::DiagnosticStatus& status = msg.status[i];
+    usage += heapUsage(status.name) + heapUsage(status.message) + heapUsage(status.hardware_id) +
+             bufferUsage(status.values);
+    for (std::size_t j = 0; j < status.values.size(); ++j)
+    {
+      usage += heapUsage(status.values[j].key) + heapUsage(status.values[j].value);
+    }
+  }
+  return usage;
 }
+
+/// Heap held by a message allocated only while its feature is enabled [bytes]
+template <typename M>
+static std::size_t ownedUsage(const boost::scoped_ptr<M>& msg)
+{
+  return msg ? sizeof(M) + heapUsage(*msg) : 0;
+}
+
+/*
+ * Memory held by this instance [bytes]: the plugin object, the heap held by its strings, containers, messages and
+ * helpers, and its part of the ROS resources (all of them if they are its own, an even share if they are shared).
+ * Not counted are the spinner threads' stacks and the mapped record file, which reportMemoryUsage names
+ * separately, and what roscpp and Gazebo allocate inside for the instance's node, topics and sensors.
+ */
+std::size_t GazeboRosKobuki::memoryUsage()
+{
+  std::size_t usage = sizeof(*this);
+  usage += heapUsage(node_name_) + heapUsage(tf_prefix_) +
+           heapUsage(base_link_frame_) + heapUsage(odom_frame_) + heapUsage(base_frame_) +
+           heapUsage(left_wheel_joint_name_) + heapUsage(right_wheel_joint_name_);
+  usage += heapUsage(joint_state_) + heapUsage(odom_) + heapUsage(odom_tf_) + heapUsage(imu_msg_) +
+           heapUsage(sensor_state_);
+  usage += joint_state_pool_.memoryUsage(heapUsage) + odom_pool_.memoryUsage(heapUsage) +
+           imu_pool_.memoryUsage(heapUsage) + core_sim_pool_.memoryUsage(heapUsage);
+  usage += ownedUsage(step_result_) + ownedUsage(core_sim_) + ownedUsage(telemetry_) + ownedUsage(diagnostics_);
+  {
+    boost::mutex::scoped_lock lock(stamped_cmd_mutex_);
+    usage += bufferUsage(stamped_cmds_);
+  }
+  usage += bufferUsage(bumper_collisions_);
+  usage += noise_model_.memoryUsage() + floor_cache_.memoryUsage();
+  if (gazebo_ros_)
+  {
+    usage += sizeof(GazeboRos);
+  }
+  if (step_nh_)
+  {
+    usage += sizeof(ros::NodeHandle);
+  }
+  if (profiler_)
+  {
+    usage += sizeof(StageProfiler) + profiler_->memoryUsage();
+  }
+  if (latency_tracer_)
+  {
+    usage += sizeof(CommandLatencyTracer) + latency_tracer_->memoryUsage();
+  }
+  if (ros_resources_)
+  {
+    usage += (sizeof(RosResources) + ros_resources_->memoryUsage()) / ros_resources_.use_count();
+  }
+  return usage;
+}
+
+void GazeboRosKobuki::reportMemoryUsage()
+{
+  std::size_t usage = memoryUsage();
+  unsigned int threads = ros_resources_ ? ros_resources_->spinnerThreads() : 0;
+  ROS_INFO_STREAM("Instance holds " << (usage + 512) / 1024 << " KiB (with its share of the ROS resources)."
+                  << " Not counted: the stacks of " << threads << " spinner thread(s)"
+                  << ((ros_resources_.use_count() > 1) ? " shared by all instances" : "")
+                  << ", " << (recorder_.mappedSize() + 512) / 1024 << " KiB of mapped record file"
+                  << " and what roscpp and Gazebo allocate for the instance." << " [" << node_name_ <<"]");
+}
+
+/*
+ * Prepare running the cliff and bumper sensors only while they are needed
+ */
+void GazeboRosKobuki::prepareSensorActivation()
+{
+  state_.lazy_sensor_activation = config_->lazy_sensor_activation;
+  if (state_.lazy_sensor_activation)
+  {
+    ROS_INFO_STREAM("Will run the cliff and bumper sensors only while their readings are subscribed to."
+                    << " [" << node_name_ <<"]");
+  }
+}
+
+/*
+ * Pause the cliff sensors' ray casts while they are over floor they have already measured to be flat. The cache
+ * is learned from the sensors' own measurements, so cliff events don't change: paused sensors keep reporting the
+ * floor they measured last, and they are back on before they reach a cell that isn't known to be flat.
+ */
+void GazeboRosKobuki::prepareFloorCache()
+{
+  if (config_->floor_cache_cell_size <= 0.0)
+  {
+    return;
+  }
+  floor_cache_.configure(config_->floor_cache_cell_size, config_->floor_cache_tolerance,
+                         config_->floor_cache_samples, config_->floor_cache_margin);
+  for (unsigned int i = 0; i < SENSOR_COUNT; ++i)
+  {
+    cliff_poses_[i] = api::sensorPose(*cliff_sensors_[i]);
+  }
+  ROS_INFO_STREAM("Will pause the cliff sensors on known flat floor (cells of " << config_->floor_cache_cell_size
+                  << " m, " << config_->floor_cache_margin << " cell(s) margin)." << " [" << node_name_ <<"]");
+}
+
 }
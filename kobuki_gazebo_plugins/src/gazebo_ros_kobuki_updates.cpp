@@ -38,29 +38,157 @@
 
 namespace gazebo {
 
+/*
+ * Read everything the update needs from Gazebo's joints and sensors
+ */
+void GazeboRosKobuki::readSensors(const common::Time& step_time)
+{
+  {
+    StageTimer timer(profiler_.get(), STAGE_SENSORS);
+    // Just as in the Kobuki driver, the angular velocity is taken directly from the IMU
+    state_.vel_angular = imu_->AngularVelocity();
+    if (state_.kinematic)
+    {
+      // the model moved by exactly the smoothed wheel speeds, so they are what the encoders and gyro measure
+      for (unsigned int side = LEFT; side <= RIGHT; ++side)
+      {
+        state_.joint_vel[side] = drive_model_.jointVelocity(velocity_smoother_.speed(side));
+        state_.kinematic_wheel_position[side] += state_.joint_vel[side] * step_time.Double();
+      }
+      api::setZ(state_.vel_angular, (velocity_smoother_.speed(RIGHT) - velocity_smoother_.speed(LEFT)) / wheel_sep_);
+    }
+    else
+    {
+      state_.joint_vel[LEFT] = joints_[LEFT]->GetVelocity(0);
+      state_.joint_vel[RIGHT] = joints_[RIGHT]->GetVelocity(0);
+    }
+    state_.wheel_vel[LEFT] = state_.joint_vel[LEFT];
+    state_.wheel_vel[RIGHT] = state_.joint_vel[RIGHT];
+    if (noise_model_.enabled())
+    {
+      applySensorNoise(step_time.Double());
+    }
+  }
+  if (state_.cliff_sensors_active)
+  {
+    StageTimer timer(profiler_.get(), STAGE_CLIFF);
+    // one (locking) read per sensor, and none while the sensor hasn't measured again
+    unsigned int measured = 0;
+    for (unsigned int i = 0; i < SENSOR_COUNT; ++i)
+    {
+      common::Time update_time = api::lastUpdateTime(*cliff_sensors_[i]);
+      if (update_time != state_.cliff_update_time[i])
+      {
+        measured |= (1u << i);
+      }
+      if (!state_.skip_unchanged_sensors || (measured & (1u << i)))
+      {
+        state_.cliff_update_time[i] = update_time;
+        state_.cliff_range[i] = cliff_sensors_[i]->Range(0);
+      }
+    }
+    if (floor_cache_.enabled())
+    {
+      updateFloorCache(measured);
+    }
+  }
+  if (state_.bumper_active && bumperChanged())
+  {
+    StageTimer timer(profiler_.get(), STAGE_BUMPER);
+    readBumper();
+  }
+}
+
+/*
+ * Learn the floor from the new cliff measurements (bit SENSOR_LEFT etc. of measured), then ask for the sensors
+ * to be paused while all of them are over known flat floor and resumed as soon as one isn't (done by
+ * pauseCliffSensors). The ranges kept in state_.cliff_range while paused are floor ones, so the cliff state doesn't
+ * change.
+ */
+void GazeboRosKobuki::updateFloorCache(unsigned int measured)
+{
+  // clearly floor, i.e. not even within the hysteresis band of the cliff detection
+  double floor_range = state_.cliff_detection_threshold - state_.cliff_detection_hysteresis;
+  bool flat = true;
+  for (unsigned int i = 0; i < SENSOR_COUNT; ++i)
+  {
+    api::Pose pose = cliff_poses_[i] + api::worldPose(*cliff_links_[i]);
+    double x = api::x(api::position(pose));
+    double y = api::y(api::position(pose));
+    if (measured & (1u << i))
+    {
+      floor_cache_.addSample(x, y, state_.cliff_range[i], state_.cliff_range[i] < floor_range);
+    }
+    flat = flat && floor_cache_.flatAround(x, y);
+  }
+  // the floor ranges held must match the flat cells' ones, not a measurement taken before
+  // the first update (or a cliff)
+  state_.cliff_sensors_pausing = flat && (state_.cliff_state == 0) &&
+                                 (state_.cliff_update_time[SENSOR_LEFT] != common::Time());
+}
+
+/*
+ * Switch the cliff sensors as the floor cache asked for, on the update thread
+ */
+void GazeboRosKobuki::pauseCliffSensors()
+{
+  for (unsigned int i = 0; i < SENSOR_COUNT; ++i)
+  {
+    cliff_sensors_[i]->SetActive(!state_.cliff_sensors_pausing);
+  }
+  state_.cliff_sensors_paused = state_.cliff_sensors_pausing;
+}
+
+/*
+ * Replace the true wheel velocities and yaw rate by measured ones, so odometry, joint states and IMU all see
+ * the same noisy values
+ */
+void GazeboRosKobuki::applySensorNoise(double step)
+{
+  double position[2] = {wheelPosition(LEFT), wheelPosition(RIGHT)};
+  noise_model_.measureWheels(step, position, state_.wheel_vel);
+  api::setZ(state_.vel_angular, noise_model_.measureYawRate(step, api::z(state_.vel_angular)));
+  noise_model_.replenish();
+}
+
+double GazeboRosKobuki::yawRate() const
+{
+  return api::z(state_.vel_angular);
+}
+
+double GazeboRosKobuki::wheelPosition(unsigned int side) const
+{
+  if (state_.kinematic)
+  {
+    return state_.kinematic_wheel_position[side];
+  }
+  return api::jointPosition(*joints_[side], 0);
+}
 
 void GazeboRosKobuki::updateJointState()
 {
   /*
    * Joint states
    */
-  std::string baselink_frame = gazebo_ros_->resolveTF("base_link");
-  joint_state_.header.stamp = ros::Time::now();
-  joint_state_.header.frame_id = baselink_frame;
-
-  #if GAZEBO_MAJOR_VERSION >= 9
-    joint_state_.position[LEFT] = joints_[LEFT]->Position(0);
-    joint_state_.position[RIGHT] = joints_[RIGHT]->Position(0);
-  #else
-    joint_state_.position[LEFT] = joints_[LEFT]->GetAngle(0).Radian();
-    joint_state_.position[RIGHT] = joints_[RIGHT]->GetAngle(0).Radian();
-  #endif
-
-  joint_state_.velocity[LEFT] = joints_[LEFT]->GetVelocity(0);
-  joint_state_.velocity[RIGHT] = joints_[RIGHT]->GetVelocity(0);
+  double values[4] = {wheelPosition(LEFT), wheelPosition(RIGHT), state_.wheel_vel[LEFT], state_.wheel_vel[RIGHT]};
+  if (!joint_state_filter_.pass(values, state_.prev_update_time.Double()))
+  {
+    return;
+  }
+  // fill a pooled message in place if intra-process publishing is enabled, the member message otherwise
+  if (joint_state_pool_.enabled())
+  {
+    joint_state_out_ = joint_state_pool_.acquire();
+  }
+  sensor_msgs::JointState& joint_state = joint_state_out_ ? *joint_state_out_ : joint_state_;
+  joint_state.header.stamp = state_.update_stamp;
 
+  joint_state.position[LEFT] = values[0];
+  joint_state.position[RIGHT] = values[1];
 
-  joint_state_pub_.publish(joint_state_);
+  joint_state.velocity[LEFT] = values[2];
+  joint_state.velocity[RIGHT] = values[3];
+  state_.outbox |= OUT_JOINT_STATE;
 }
 
 /*
@@ -68,343 +196,595 @@ void GazeboRosKobuki::updateJointState()
  */
 void GazeboRosKobuki::updateOdometry(common::Time& step_time)
 {
-  std::string odom_frame = gazebo_ros_->resolveTF("odom");
-  std::string base_frame = gazebo_ros_->resolveTF("base_footprint");
-  odom_.header.stamp = joint_state_.header.stamp;
-  odom_.header.frame_id = odom_frame;
-  odom_.child_frame_id = base_frame;
-
-  // Distance travelled by main wheels
-  double d1, d2;
-  double dr, da;
-  d1 = d2 = 0;
-  dr = da = 0;
-  d1 = step_time.Double() * (wheel_diam_ / 2) * joints_[LEFT]->GetVelocity(0);
-  d2 = step_time.Double() * (wheel_diam_ / 2) * joints_[RIGHT]->GetVelocity(0);
-  // Can see NaN values here, just zero them out if needed
-  if (std::isnan(d1))
+  StageTimer timer(profiler_.get(), STAGE_ODOMETRY);
+  unsigned int nan_flags = drive_model_.integrate(step_time.Double(),
+                                                  state_.wheel_vel[LEFT], state_.wheel_vel[RIGHT], yawRate(),
+                                                  state_.odom_pose[0], state_.odom_pose[1], state_.odom_pose[2],
+                                                  state_.odom_vel[0], state_.odom_vel[2]);
+  state_.odom_vel[1] = 0.0;
+  warnOdometryNaN(nan_flags, step_time);
+}
+
+void GazeboRosKobuki::warnOdometryNaN(unsigned int nan_flags, const common::Time& step_time)
+{
+  if (nan_flags & ODOM_NAN_LEFT)
   {
     ROS_WARN_STREAM_THROTTLE(0.1, "Gazebo ROS Kobuki plugin: NaN in d1. Step time: " << step_time.Double()
-                             << ", WD: " << wheel_diam_ << ", velocity: " << joints_[LEFT]->GetVelocity(0));
-    d1 = 0;
+                             << ", WD: " << wheel_diam_ << ", velocity: " << state_.wheel_vel[LEFT]);
   }
-  if (std::isnan(d2))
+  if (nan_flags & ODOM_NAN_RIGHT)
   {
     ROS_WARN_STREAM_THROTTLE(0.1, "Gazebo ROS Kobuki plugin: NaN in d2. Step time: " << step_time.Double()
-                             << ", WD: " << wheel_diam_ << ", velocity: " << joints_[RIGHT]->GetVelocity(0));
-    d2 = 0;
+                             << ", WD: " << wheel_diam_ << ", velocity: " << state_.wheel_vel[RIGHT]);
   }
-  dr = (d1 + d2) / 2;
-  da = (d2 - d1) / wheel_sep_; // ignored
+}
 
-  // Just as in the Kobuki driver, the angular velocity is taken directly from the IMU
-  vel_angular_ = imu_->AngularVelocity();
+/*
+ * Fill the measurements of an odometry message prepared by prepareMessages
+ */
+void GazeboRosKobuki::fillOdometry(nav_msgs::Odometry& odom) const
+{
+  odom.header.stamp = state_.update_stamp;
+  odom.pose.pose.position.x = state_.odom_pose[0];
+  odom.pose.pose.position.y = state_.odom_pose[1];
 
-  // Compute odometric pose
-  odom_pose_[0] += dr * cos( odom_pose_[2] );
-  odom_pose_[1] += dr * sin( odom_pose_[2] );
+  tf::Quaternion qt;
+  qt.setEuler(0,0,state_.odom_pose[2]);
+  odom.pose.pose.orientation.x = qt.getX();
+  odom.pose.pose.orientation.y = qt.getY();
+  odom.pose.pose.orientation.z = qt.getZ();
+  odom.pose.pose.orientation.w = qt.getW();
+
+  odom.twist.twist.linear.x = state_.odom_vel[0];
+  odom.twist.twist.angular.z = state_.odom_vel[2];
+}
 
-  #if GAZEBO_MAJOR_VERSION >= 9
-    odom_pose_[2] += vel_angular_.Z() * step_time.Double();
-  #else
-    odom_pose_[2] += vel_angular_.z * step_time.Double();
-  #endif
+/*
+ * Odometry message of the pose integrated in updateOdometry
+ */
+void GazeboRosKobuki::updateOdometryMessage()
+{
+  double values[5] = {state_.odom_pose[0], state_.odom_pose[1], state_.odom_pose[2],
+                      state_.odom_vel[0], state_.odom_vel[2]};
+  if (!odom_filter_.pass(values, state_.prev_update_time.Double()))
+  {
+    return;
+  }
+  if (odom_pool_.enabled())
+  {
+    odom_out_ = odom_pool_.acquire();
+  }
+  fillOdometry(odom_out_ ? *odom_out_ : odom_);
+  if (latency_tracer_)
+  {
+    latency_tracer_->reach(CommandLatencyTracer::ODOMETRY, update_count_.load(std::memory_order_relaxed));
+  }
+  state_.outbox |= OUT_ODOM;
+}
 
-  // Compute odometric instantaneous velocity
-  odom_vel_[0] = dr / step_time.Double();
-  odom_vel_[1] = 0.0;
+/*
+ * Fill the odom -> base_footprint transform; returns false (and leaves it) while the pose hasn't changed by
+ * the tf thresholds since the transform was last filled, unless the heartbeat is due
+ */
+bool GazeboRosKobuki::fillTf()
+{
+  double now = state_.prev_update_time.Double();
+  if ((tf_min_translation_ > 0.0) || (tf_min_rotation_ > 0.0))
+  {
+    double translation = std::hypot(state_.odom_pose[0] - state_.tf_sent_pose[0],
+                                    state_.odom_pose[1] - state_.tf_sent_pose[1]);
+    double rotation = std::fabs(std::remainder(state_.odom_pose[2] - state_.tf_sent_pose[2], 2.0 * M_PI));
+    // also due before the first transform (NaN time) and after the time jumped back
+    bool heartbeat_due = !(now >= state_.tf_sent_time) ||
+                         ((heartbeat_period_ > 0.0) && (now - state_.tf_sent_time >= heartbeat_period_));
+    if ((translation <= tf_min_translation_) && (rotation <= tf_min_rotation_) && !heartbeat_due)
+    {
+      return false;
+    }
+  }
+  state_.tf_sent_pose[0] = state_.odom_pose[0];
+  state_.tf_sent_pose[1] = state_.odom_pose[1];
+  state_.tf_sent_pose[2] = state_.odom_pose[2];
+  state_.tf_sent_time = now;
 
-  #if GAZEBO_MAJOR_VERSION >= 9
-    odom_vel_[2] = vel_angular_.Z();
+  odom_tf_.header.stamp = state_.update_stamp;
+  odom_tf_.transform.translation.x = state_.odom_pose[0];
+  odom_tf_.transform.translation.y = state_.odom_pose[1];
 
-  #else
-    odom_vel_[2] = vel_angular_.z;
-  #endif
+  tf::Quaternion qt;
+  qt.setEuler(0,0,state_.odom_pose[2]);
+  odom_tf_.transform.rotation.x = qt.getX();
+  odom_tf_.transform.rotation.y = qt.getY();
+  odom_tf_.transform.rotation.z = qt.getZ();
+  odom_tf_.transform.rotation.w = qt.getW();
+  return true;
+}
 
-  odom_.pose.pose.position.x = odom_pose_[0];
-  odom_.pose.pose.position.y = odom_pose_[1];
-  odom_.pose.pose.position.z = 0;
+/*
+ * Fill the measurements of an IMU message prepared by prepareMessages
+ */
+void GazeboRosKobuki::fillIMU(sensor_msgs::Imu& imu_msg) const
+{
+  imu_msg.header.stamp = state_.update_stamp;
+  api::toMessage(imu_->Orientation(), imu_msg.orientation);
+  api::toMessage(state_.vel_angular, imu_msg.angular_velocity);
+  api::toMessage(imu_->LinearAcceleration(), imu_msg.linear_acceleration);
+}
 
-  tf::Quaternion qt;
-  qt.setEuler(0,0,odom_pose_[2]);
-  odom_.pose.pose.orientation.x = qt.getX();
-  odom_.pose.pose.orientation.y = qt.getY();
-  odom_.pose.pose.orientation.z = qt.getZ();
-  odom_.pose.pose.orientation.w = qt.getW();
-
-  odom_.pose.covariance[0]  = 0.1;
-  odom_.pose.covariance[7]  = 0.1;
-  odom_.pose.covariance[35] = 0.05;
-  odom_.pose.covariance[14] = 1e6;
-  odom_.pose.covariance[21] = 1e6;
-  odom_.pose.covariance[28] = 1e6;
-
-  odom_.twist.twist.linear.x = odom_vel_[0];
-  odom_.twist.twist.linear.y = 0;
-  odom_.twist.twist.linear.z = 0;
-  odom_.twist.twist.angular.x = 0;
-  odom_.twist.twist.angular.y = 0;
-  odom_.twist.twist.angular.z = odom_vel_[2];
-  odom_pub_.publish(odom_); // publish odom message
-
-  if (publish_tf_)
-  {
-    odom_tf_.header = odom_.header;
-    odom_tf_.child_frame_id = odom_.child_frame_id;
-    odom_tf_.transform.translation.x = odom_.pose.pose.position.x;
-    odom_tf_.transform.translation.y = odom_.pose.pose.position.y;
-    odom_tf_.transform.translation.z = odom_.pose.pose.position.z;
-    odom_tf_.transform.rotation = odom_.pose.pose.orientation;
-    tf_broadcaster_.sendTransform(odom_tf_);
+/*
+ * IMU message
+ */
+void GazeboRosKobuki::updateIMU()
+{
+  if (imu_filter_.enabled())
+  {
+    // the orientation as angles, so its minimum change is one in rad
+    const api::Quaternion& orientation = imu_->Orientation();
+    double values[9] = {api::roll(orientation), api::pitch(orientation), api::yaw(orientation)};
+    api::toArray(state_.vel_angular, values + 3);
+    api::toArray(imu_->LinearAcceleration(), values + 6);
+    if (!imu_filter_.pass(values, state_.prev_update_time.Double()))
+    {
+      return;
+    }
   }
+  if (imu_pool_.enabled())
+  {
+    imu_out_ = imu_pool_.acquire();
+  }
+  fillIMU(imu_out_ ? *imu_out_ : imu_msg_);
+  state_.outbox |= OUT_IMU;
 }
 
 /*
- * Publish IMU data
+ * Ramp the wheel speeds towards the velocity command, or stop them when the motors are off or the command has
+ * timed out
  */
-void GazeboRosKobuki::updateIMU()
+void GazeboRosKobuki::updateVelocitySmoother(const common::Time& time_now)
 {
-  imu_msg_.header = joint_state_.header;
-
-  #if GAZEBO_MAJOR_VERSION >= 9
-    ignition::math::Quaterniond quat = imu_->Orientation();
-    imu_msg_.orientation.x = quat.X();
-    imu_msg_.orientation.y = quat.Y();
-    imu_msg_.orientation.z = quat.Z();
-    imu_msg_.orientation.w = quat.W();
-  #else
-    math::Quaternion quat = imu_->Orientation();
-    imu_msg_.orientation.x = quat.x;
-    imu_msg_.orientation.y = quat.y;
-    imu_msg_.orientation.z = quat.z;
-    imu_msg_.orientation.w = quat.w;
-  #endif
-
-
-  imu_msg_.orientation_covariance[0] = 1e6;
-  imu_msg_.orientation_covariance[4] = 1e6;
-  imu_msg_.orientation_covariance[8] = 0.05;
-
-  #if GAZEBO_MAJOR_VERSION >= 9
-    imu_msg_.angular_velocity.x = vel_angular_.X();
-    imu_msg_.angular_velocity.y = vel_angular_.Y();
-    imu_msg_.angular_velocity.z = vel_angular_.Z();
-  #else
-    imu_msg_.angular_velocity.x = vel_angular_.x;
-    imu_msg_.angular_velocity.y = vel_angular_.y;
-    imu_msg_.angular_velocity.z = vel_angular_.z;
-  #endif
-
-
-  imu_msg_.angular_velocity_covariance[0] = 1e6;
-  imu_msg_.angular_velocity_covariance[4] = 1e6;
-  imu_msg_.angular_velocity_covariance[8] = 0.05;
-
-  #if GAZEBO_MAJOR_VERSION >= 9
-    ignition::math::Vector3d lin_acc = imu_->LinearAcceleration();
-    imu_msg_.linear_acceleration.x = lin_acc.X();
-    imu_msg_.linear_acceleration.y = lin_acc.Y();
-    imu_msg_.linear_acceleration.z = lin_acc.Z();
-  #else
-    math::Vector3 lin_acc = imu_->LinearAcceleration();
-    imu_msg_.linear_acceleration.x = lin_acc.x;
-    imu_msg_.linear_acceleration.y = lin_acc.y;
-    imu_msg_.linear_acceleration.z = lin_acc.z;
-  #endif
-
-
-  imu_pub_.publish(imu_msg_); // publish odom message
+  if (!motors_enabled_)
+  {
+    state_.wheel_speed_cmd[LEFT] = 0.0;
+    state_.wheel_speed_cmd[RIGHT] = 0.0;
+    velocity_smoother_.reset();
+  }
+  else if ((time_now - state_.last_cmd_vel_time).Double() > state_.cmd_vel_timeout)
+  {
+    state_.wheel_speed_cmd[LEFT] = 0.0;
+    state_.wheel_speed_cmd[RIGHT] = 0.0;
+  }
+  state_.wheel_speeds_changed = velocity_smoother_.update(state_.update_step, state_.wheel_speed_cmd);
+  if (latency_tracer_)
+  {
+    latency_tracer_->reach(CommandLatencyTracer::APPLIED, update_count_.load(std::memory_order_relaxed));
+  }
 }
 
 /*
  * Propagate velocity commands
- * TODO: Check how to simulate disabled motors, e.g. set MaxForce to zero, but then damping is important!
+ * Commands taken over by beginUpdate are written to the joints by the same update, so they act on the next
+ * physics step.
+ * With the joint motors, the target velocity is only written when the smoothed speeds change and disabled
+ * motors drop their max. force, so the wheels roll freely. Otherwise the joint velocity is forced, so the
+ * joints are also written when they have drifted from the target by more than the tolerance, and disabled
+ * motors hold the wheels still. In the kinematic mode, the model itself is moved instead.
  */
 void GazeboRosKobuki::propagateVelocityCommands()
 {
-  if (((prev_update_time_- last_cmd_vel_time_).Double() > cmd_vel_timeout_) || !motors_enabled_)
+  bool changed = state_.wheel_speeds_changed;
+  if (state_.kinematic)
+  {
+    moveKinematically();
+    return;
+  }
+  if (state_.joint_motors)
   {
-    wheel_speed_cmd_[LEFT] = 0.0;
-    wheel_speed_cmd_[RIGHT] = 0.0;
+    double force = motors_enabled_ ? torque_ : 0.0;
+    if (force != state_.joint_motor_force)
+    {
+      setJointMotorForce(force);
+    }
+    if (changed)
+    {
+      joints_[LEFT]->SetParam("vel", 0, drive_model_.jointVelocity(velocity_smoother_.speed(LEFT)));
+      joints_[RIGHT]->SetParam("vel", 0, drive_model_.jointVelocity(velocity_smoother_.speed(RIGHT)));
+      joint_writes_ += 2;
+    }
+    return;
+  }
+  for (unsigned int side = LEFT; side <= RIGHT; ++side)
+  {
+    double joint_velocity = drive_model_.jointVelocity(velocity_smoother_.speed(side));
+    if (changed || (std::fabs(state_.joint_vel[side] - joint_velocity) > joint_velocity_tolerance_))
+    {
+      joints_[side]->SetVelocity(0, joint_velocity);
+      ++joint_writes_;
+    }
   }
-  joints_[LEFT]->SetVelocity(0, wheel_speed_cmd_[LEFT] / (wheel_diam_ / 2.0));
-  joints_[RIGHT]->SetVelocity(0, wheel_speed_cmd_[RIGHT] / (wheel_diam_ / 2.0));
+}
+
+/*
+ * Kinematic mode: advance the model's pose over the coming step with the odometry math, from wherever it is now
+ * (so it still falls, and can be placed by others), and give it the matching velocity, so the physics engine
+ * moves it smoothly and its contacts (e.g. with the bumper) are still detected
+ */
+void GazeboRosKobuki::moveKinematically()
+{
+  if (state_.update_step <= 0.0)
+  {
+    return;
+  }
+  const api::Pose& pose = api::worldPose(*model_);
+  double x = api::x(api::position(pose));
+  double y = api::y(api::position(pose));
+  double yaw = api::yaw(api::rotation(pose));
+  double left = drive_model_.jointVelocity(velocity_smoother_.speed(LEFT));
+  double right = drive_model_.jointVelocity(velocity_smoother_.speed(RIGHT));
+  double yaw_rate = (velocity_smoother_.speed(RIGHT) - velocity_smoother_.speed(LEFT)) / wheel_sep_;
+  double linear_vel, angular_vel;
+  drive_model_.integrate(state_.update_step, left, right, yaw_rate, x, y, yaw, linear_vel, angular_vel);
+  double z = api::z(api::position(pose));
+  model_->SetWorldPose(api::Pose(x, y, z, 0.0, 0.0, yaw));
+  model_->SetLinearVel(api::Vector3(linear_vel * std::cos(yaw), linear_vel * std::sin(yaw), 0.0));
+  model_->SetAngularVel(api::Vector3(0.0, 0.0, angular_vel));
+}
+
+void GazeboRosKobuki::setJointMotorForce(double force)
+{
+  joints_[LEFT]->SetParam("fmax", 0, force);
+  joints_[RIGHT]->SetParam("fmax", 0, force);
+  state_.joint_motor_force = force;
+  joint_writes_ += 2;
 }
 
 /*
  * Cliff sensors
- * Check each sensor separately
+ * Fill an event for each sensor whose cliff state changed on the current update
  */
 void GazeboRosKobuki::updateCliffSensor()
 {
-  // Left cliff sensor
-  if ((cliff_detected_left_ == false) &&
-      (cliff_sensor_left_->Range(0) >= cliff_detection_threshold_))
-  {
-    cliff_detected_left_ = true;
-    cliff_event_.sensor = kobuki_msgs::CliffEvent::LEFT;
-    cliff_event_.state = kobuki_msgs::CliffEvent::CLIFF;
-    // convert distance back to an AD reading
-    cliff_event_.bottom = (int)(76123.0f * atan2(0.995f, cliff_sensor_left_->Range(0)));
-    cliff_event_pub_.publish(cliff_event_);
-  }
-  else if ((cliff_detected_left_ == true) &&
-            (cliff_sensor_left_->Range(0) < cliff_detection_threshold_))
-  {
-    cliff_detected_left_ = false;
-    cliff_event_.sensor = kobuki_msgs::CliffEvent::LEFT;
-    cliff_event_.state = kobuki_msgs::CliffEvent::FLOOR;
-    // convert distance back to an AD reading
-    cliff_event_.bottom = (int)(76123.0f * atan2(0.995f, cliff_sensor_left_->Range(0)));
-    cliff_event_pub_.publish(cliff_event_);
-  }
-  // Centre cliff sensor
-  if ((cliff_detected_center_ == false) &&
-      (cliff_sensor_center_->Range(0) >= cliff_detection_threshold_))
-  {
-    cliff_detected_center_ = true;
-    cliff_event_.sensor = kobuki_msgs::CliffEvent::CENTER;
-    cliff_event_.state = kobuki_msgs::CliffEvent::CLIFF;
-    // convert distance back to an AD reading
-    cliff_event_.bottom = (int)(76123.0f * atan2(0.995f, cliff_sensor_center_->Range(0)));
-    cliff_event_pub_.publish(cliff_event_);
-  }
-  else if ((cliff_detected_center_ == true) &&
-            (cliff_sensor_center_->Range(0) < cliff_detection_threshold_))
-  {
-    cliff_detected_center_ = false;
-    cliff_event_.sensor = kobuki_msgs::CliffEvent::CENTER;
-    cliff_event_.state = kobuki_msgs::CliffEvent::FLOOR;
-    // convert distance back to an AD reading
-    cliff_event_.bottom = (int)(76123.0f * atan2(0.995f, cliff_sensor_center_->Range(0)));
-    cliff_event_pub_.publish(cliff_event_);
-  }
-  // Right cliff sensor
-  if ((cliff_detected_right_ == false) &&
-      (cliff_sensor_right_->Range(0) >= cliff_detection_threshold_))
-  {
-    cliff_detected_right_ = true;
-    cliff_event_.sensor = kobuki_msgs::CliffEvent::RIGHT;
-    cliff_event_.state = kobuki_msgs::CliffEvent::CLIFF;
-    // convert distance back to an AD reading
-    cliff_event_.bottom = (int)(76123.0f * atan2(0.995f, cliff_sensor_right_->Range(0)));
-    cliff_event_pub_.publish(cliff_event_);
-  }
-  else if ((cliff_detected_right_ == true) &&
-            (cliff_sensor_right_->Range(0) < cliff_detection_threshold_))
-  {
-    cliff_detected_right_ = false;
-    cliff_event_.sensor = kobuki_msgs::CliffEvent::RIGHT;
-    cliff_event_.state = kobuki_msgs::CliffEvent::FLOOR;
-    // convert distance back to an AD reading
-    cliff_event_.bottom = (int)(76123.0f * atan2(0.995f, cliff_sensor_right_->Range(0)));
-    cliff_event_pub_.publish(cliff_event_);
+  state_.cliff_events_out = state_.cliff_state ^ state_.cliff_detected;
+  // the sensor indices are the same as kobuki_msgs::CliffEvent's LEFT, CENTER and RIGHT
+  for (unsigned int i = 0; i < SENSOR_COUNT; ++i)
+  {
+    if (state_.cliff_events_out & (1u << i))
+    {
+      kobuki_msgs::CliffEvent& cliff_event = cliff_events_[i];
+      cliff_event.sensor = i;
+      cliff_event.state = (state_.cliff_state & (1u << i)) ? kobuki_msgs::CliffEvent::CLIFF
+                                                     : kobuki_msgs::CliffEvent::FLOOR;
+      // convert distance back to an AD reading
+      cliff_event.bottom = CliffADTable::instance()(state_.cliff_range[i]);
+    }
+  }
+  state_.cliff_detected = state_.cliff_state;
+}
+
+/*
+ * Raw cliff and bumper readings in the layout of the Kobuki driver's core sensor stream
+ */
+void GazeboRosKobuki::fillSensorState(kobuki_msgs::SensorState& sensor_state) const
+{
+  // the driver's bit masks and bottom readings are ordered right, centre, left
+  static const uint8_t cliff_bits[SENSOR_COUNT] = {kobuki_msgs::SensorState::CLIFF_LEFT,
+                                                   kobuki_msgs::SensorState::CLIFF_CENTRE,
+                                                   kobuki_msgs::SensorState::CLIFF_RIGHT};
+  static const uint8_t bumper_bits[SENSOR_COUNT] = {kobuki_msgs::SensorState::BUMPER_LEFT,
+                                                    kobuki_msgs::SensorState::BUMPER_CENTRE,
+                                                    kobuki_msgs::SensorState::BUMPER_RIGHT};
+  unsigned int bumper_state = bumperState();
+  sensor_state.header.frame_id = base_link_frame_;
+  sensor_state.header.stamp = state_.update_stamp;
+  sensor_state.time_stamp = (uint16_t)(state_.prev_update_time.Double() * 1000.0);
+  sensor_state.cliff = 0;
+  sensor_state.bumper = 0;
+  sensor_state.left_encoder = wheelEncoderTicks(wheelPosition(LEFT));
+  sensor_state.right_encoder = wheelEncoderTicks(wheelPosition(RIGHT));
+  sensor_state.bottom.resize(SENSOR_COUNT);
+  for (unsigned int i = 0; i < SENSOR_COUNT; ++i)
+  {
+    sensor_state.cliff |= (state_.cliff_state & (1u << i)) ? cliff_bits[i] : 0;
+    sensor_state.bumper |= (bumper_state & (1u << i)) ? bumper_bits[i] : 0;
+    sensor_state.bottom[SENSOR_COUNT - 1 - i] = CliffADTable::instance()(state_.cliff_range[i]);
   }
+  // in 0.1 V, as reported by the driver
+  sensor_state.battery = battery_.enabled() ? (uint8_t)(battery_.voltage() * 10.0) : 0;
+}
+
+void GazeboRosKobuki::updateSensorState()
+{
+  fillSensorState(sensor_state_);
+  state_.outbox |= OUT_SENSOR_STATE;
+}
+
+/*
+ * Combined robot state, built from the state of the current update like the separate streams
+ */
+void GazeboRosKobuki::updateCoreSim()
+{
+  if (core_sim_pool_.enabled())
+  {
+    core_sim_out_ = core_sim_pool_.acquire();
+  }
+  kobuki_gazebo_plugins::CoreSim& core_sim = core_sim_out_ ? *core_sim_out_ : *core_sim_;
+  core_sim.header.stamp = state_.update_stamp;
+  fillSensorState(core_sim.sensors);
+  for (unsigned int side = LEFT; side <= RIGHT; ++side)
+  {
+    core_sim.wheel_position[side] = wheelPosition(side);
+    core_sim.wheel_velocity[side] = state_.wheel_vel[side];
+  }
+  core_sim.odom_pose.x = state_.odom_pose[0];
+  core_sim.odom_pose.y = state_.odom_pose[1];
+  core_sim.odom_pose.theta = state_.odom_pose[2];
+  core_sim.odom_linear_velocity = state_.odom_vel[0];
+  core_sim.odom_angular_velocity = state_.odom_vel[2];
+  core_sim.gyro_heading = api::yaw(imu_->Orientation());
+  core_sim.gyro_yaw_rate = yawRate();
+  state_.outbox |= OUT_CORE_SIM;
+}
+
+/*
+ * Drain the battery, add the current update to the telemetry window and fill the telemetry message when due
+ */
+void GazeboRosKobuki::updateTelemetry(const common::Time& time_now)
+{
+  if (battery_.enabled())
+  {
+    battery_.update(state_.update_step, velocity_smoother_.speed(LEFT), velocity_smoother_.speed(RIGHT));
+  }
+  if (!state_.publish_telemetry)
+  {
+    return;
+  }
+  telemetry_heading_.add(state_.odom_pose[2]);
+  telemetry_yaw_rate_.add(yawRate());
+  telemetry_wheel_vel_[LEFT].add(state_.wheel_vel[LEFT]);
+  telemetry_wheel_vel_[RIGHT].add(state_.wheel_vel[RIGHT]);
+  if (battery_.enabled())
+  {
+    telemetry_battery_voltage_.add(battery_.voltage());
+  }
+  ++telemetry_updates_;
+  if (!telemetry_schedule_.due(time_now))
+  {
+    return;
+  }
+  telemetry_->header.stamp = state_.update_stamp;
+  telemetry_->updates = telemetry_updates_;
+  telemetry_->duration = (time_now - telemetry_start_).Double();
+  telemetry_heading_.fill(telemetry_->heading);
+  telemetry_yaw_rate_.fill(telemetry_->yaw_rate);
+  telemetry_wheel_vel_[LEFT].fill(telemetry_->left_wheel_velocity);
+  telemetry_wheel_vel_[RIGHT].fill(telemetry_->right_wheel_velocity);
+  telemetry_battery_voltage_.fill(telemetry_->battery_voltage);
+  telemetry_->battery_percentage = battery_.enabled() ? battery_.charge() * 100.0 : 0.0;
+  state_.outbox |= OUT_TELEMETRY;
+
+  telemetry_heading_.reset();
+  telemetry_yaw_rate_.reset();
+  telemetry_wheel_vel_[LEFT].reset();
+  telemetry_wheel_vel_[RIGHT].reset();
+  telemetry_battery_voltage_.reset();
+  telemetry_updates_ = 0;
+  telemetry_start_ = time_now;
 }
 
 /*
  * Bumpers
+ * Contacts are assigned to the left, centre and right bumper by bumper_sectors_, after rejecting contacts
+ * outside the bumper's height; reading stops as soon as all bumpers are pressed
  */
-// In order to simulate the three bumper sensors, a contact is assigned to one of the bumpers
-// depending on its position. Each sensor covers a range of 60 degrees.
-// +90 ... +30: left bumper
-// +30 ... -30: centre bumper
-// -30 ... -90: right bumper
-void GazeboRosKobuki::updateBumper()
+void GazeboRosKobuki::readBumper()
 {
-  // reset flags
-  bumper_left_is_pressed_ = false;
-  bumper_center_is_pressed_ = false;
-  bumper_right_is_pressed_ = false;
+  const api::Pose& current_pose = api::worldPose(*model_);
+  double robot_height = api::z(api::position(current_pose));
+  bumper_sectors_.setHeading(api::yaw(api::rotation(current_pose)));
+
+  if (state_.bumper_physics_contacts)
+  {
+    state_.bumper_is_pressed = readBumperPhysicsContacts(robot_height);
+  }
+  else
+  {
+    state_.bumper_is_pressed = readBumperSensorContacts(robot_height);
+  }
+}
 
-  // parse contacts
+/*
+ * The physics engine's contacts change on every step, the sensor's only when it updates
+ */
+bool GazeboRosKobuki::bumperChanged()
+{
+  if (state_.bumper_physics_contacts || !state_.skip_unchanged_sensors)
+  {
+    return true;
+  }
+  common::Time update_time = api::lastUpdateTime(*bumper_);
+  if (update_time == state_.bumper_update_time)
+  {
+    return false;
+  }
+  state_.bumper_update_time = update_time;
+  return true;
+}
+
+/*
+ * Contacts as last reported by the bumper sensor (copied from the sensor on every update)
+ */
+unsigned int GazeboRosKobuki::readBumperSensorContacts(double robot_height)
+{
+  const unsigned int all_pressed = (1u << SENSOR_COUNT) - 1;
   msgs::Contacts contacts;
   contacts = bumper_->Contacts();
-  double robot_heading;
-  #if GAZEBO_MAJOR_VERSION >= 9
-    ignition::math::Pose3d current_pose = model_->WorldPose();
-    robot_heading = current_pose.Rot().Yaw();
-  #else
-    math::Pose current_pose = model_->GetWorldPose();
-    robot_heading = current_pose.rot.GetYaw();
-  #endif
-
-
-  for (int i = 0; i < contacts.contact_size(); ++i)
-  {
-    double rel_contact_pos;
-    #if GAZEBO_MAJOR_VERSION >= 9
-      rel_contact_pos =  contacts.contact(i).position(0).z() - current_pose.Pos().Z();
-    #else
-      rel_contact_pos =  contacts.contact(i).position(0).z() - current_pose.pos.z;
-    #endif
-    // Actually, only contacts at the height of the bumper should be considered, but since we use a simplified collision model
-    // contacts further below and above need to be consider as well to identify "bumps" reliably.
-    if ((rel_contact_pos >= 0.01)
-        && (rel_contact_pos <= 0.13))
+  unsigned int pressed = 0;
+  for (int i = 0; (i < contacts.contact_size()) && (pressed != all_pressed); ++i)
+  {
+    const msgs::Contact& contact = contacts.contact(i);
+    if (isBumperContactHeight(contact.position(0).z() - robot_height))
     {
-      // using the force normals below, since the contact position is given in world coordinates
-      // also negating the normal, because it points from contact to robot centre
-      double global_contact_angle = std::atan2(-contacts.contact(i).normal(0).y(), -contacts.contact(i).normal(0).x());
-      double relative_contact_angle = global_contact_angle - robot_heading;
+      // using the force normals, since the contact position is given in world coordinates
+      pressed |= bumper_sectors_.classify(contact.normal(0).x(), contact.normal(0).y());
+    }
+  }
+  return pressed;
+}
 
-      if ((relative_contact_angle <= (M_PI/2)) && (relative_contact_angle > (M_PI/6)))
-      {
-        bumper_left_is_pressed_ = true;
-      }
-      else if ((relative_contact_angle <= (M_PI/6)) && (relative_contact_angle >= (-M_PI/6)))
+/*
+ * Contacts of the current physics step, read in place from the contact manager. The bumper sensor's contact
+ * filter makes the contact manager keep the bumper's contacts.
+ */
+unsigned int GazeboRosKobuki::readBumperPhysicsContacts(double robot_height)
+{
+  const unsigned int all_pressed = (1u << SENSOR_COUNT) - 1;
+  physics::ContactManager* contact_manager = api::physicsEngine(*world_)->GetContactManager();
+  const std::vector<physics::Contact*>& contacts = contact_manager->GetContacts();
+  // the vector is reused between steps, only the first GetContactCount() entries are current
+  unsigned int contact_count = contact_manager->GetContactCount();
+  unsigned int pressed = 0;
+  for (unsigned int i = 0; (i < contact_count) && (pressed != all_pressed); ++i)
+  {
+    const physics::Contact& contact = *contacts[i];
+    if (contact.count < 1)
+    {
+      continue;
+    }
+    // the normal points into collision1, flip it if the bumper is collision2
+    double normal_sign = 0.0;
+    for (std::size_t j = 0; j < bumper_collisions_.size(); ++j)
+    {
+      if (contact.collision1 == bumper_collisions_[j].get())
       {
-        bumper_center_is_pressed_ = true;
+        normal_sign = 1.0;
       }
-      else if ((relative_contact_angle < (-M_PI/6)) && (relative_contact_angle >= (-M_PI/2)))
+      else if (contact.collision2 == bumper_collisions_[j].get())
       {
-        bumper_right_is_pressed_ = true;
+        normal_sign = -1.0;
       }
     }
+    if (normal_sign == 0.0)
+    {
+      continue;
+    }
+    double contact_height = api::z(contact.positions[0]);
+    double normal_x = normal_sign * api::x(contact.normals[0]);
+    double normal_y = normal_sign * api::y(contact.normals[0]);
+    if (isBumperContactHeight(contact_height - robot_height))
+    {
+      pressed |= bumper_sectors_.classify(normal_x, normal_y);
+    }
   }
+  return pressed;
+}
 
-  // check for bumper state change
-  if (bumper_left_is_pressed_ && !bumper_left_was_pressed_)
-  {
-    bumper_left_was_pressed_ = true;
-    bumper_event_.state = kobuki_msgs::BumperEvent::PRESSED;
-    bumper_event_.bumper = kobuki_msgs::BumperEvent::LEFT;
-    bumper_event_pub_.publish(bumper_event_);
-  }
-  else if (!bumper_left_is_pressed_ && bumper_left_was_pressed_)
+/*
+ * Bumper state as bit mask (bit SENSOR_LEFT etc.)
+ */
+unsigned int GazeboRosKobuki::bumperState() const
+{
+  return state_.bumper_is_pressed;
+}
+
+/*
+ * Fill bumper events for the state read by readBumper
+ */
+void GazeboRosKobuki::updateBumper()
+{
+  state_.bumper_events_out = state_.bumper_is_pressed ^ state_.bumper_was_pressed;
+  // the sensor indices are the same as kobuki_msgs::BumperEvent's LEFT, CENTER and RIGHT
+  for (unsigned int i = 0; i < SENSOR_COUNT; ++i)
   {
-    bumper_left_was_pressed_ = false;
-    bumper_event_.state = kobuki_msgs::BumperEvent::RELEASED;
-    bumper_event_.bumper = kobuki_msgs::BumperEvent::LEFT;
-    bumper_event_pub_.publish(bumper_event_);
+    if (state_.bumper_events_out & (1u << i))
+    {
+      bumper_events_[i].bumper = i;
+      bumper_events_[i].state = (state_.bumper_is_pressed & (1u << i)) ? kobuki_msgs::BumperEvent::PRESSED
+                                                                 : kobuki_msgs::BumperEvent::RELEASED;
+    }
   }
-  if (bumper_center_is_pressed_ && !bumper_center_was_pressed_)
+  state_.bumper_was_pressed = state_.bumper_is_pressed;
+}
+
+/*
+ * State of the current update, taken from the same members the streams are built from
+ */
+void GazeboRosKobuki::fillStateRecord(const common::Time& time_now, KobukiStateRecord& record) const
+{
+  record.sim_sec = time_now.sec;
+  record.sim_nsec = time_now.nsec;
+  for (unsigned int side = LEFT; side <= RIGHT; ++side)
   {
-    bumper_center_was_pressed_ = true;
-    bumper_event_.state = kobuki_msgs::BumperEvent::PRESSED;
-    bumper_event_.bumper = kobuki_msgs::BumperEvent::CENTER;
-    bumper_event_pub_.publish(bumper_event_);
+    record.wheel_position[side] = wheelPosition(side);
+    record.wheel_velocity[side] = state_.wheel_vel[side];
   }
-  else if (!bumper_center_is_pressed_ && bumper_center_was_pressed_)
+  record.odom_pose[0] = state_.odom_pose[0];
+  record.odom_pose[1] = state_.odom_pose[1];
+  record.odom_pose[2] = state_.odom_pose[2];
+  record.odom_linear_vel = state_.odom_vel[0];
+  record.odom_angular_vel = state_.odom_vel[2];
+  api::toArray(imu_->Orientation(), record.imu_orientation);
+  api::toArray(state_.vel_angular, record.imu_angular_vel);
+  api::toArray(imu_->LinearAcceleration(), record.imu_linear_acc);
+  for (unsigned int i = 0; i < SENSOR_COUNT; ++i)
   {
-    bumper_center_was_pressed_ = false;
-    bumper_event_.state = kobuki_msgs::BumperEvent::RELEASED;
-    bumper_event_.bumper = kobuki_msgs::BumperEvent::CENTER;
-    bumper_event_pub_.publish(bumper_event_);
+    record.cliff_range[i] = state_.cliff_range[i];
   }
-  if (bumper_right_is_pressed_ && !bumper_right_was_pressed_)
+  record.cliff_state = state_.cliff_state;
+  record.bumper_state = bumperState();
+}
+
+void GazeboRosKobuki::recordState(const common::Time& time_now)
+{
+  KobukiStateRecord record;
+  fillStateRecord(time_now, record);
+  recorder_.append(record);
+}
+
+/*
+ * Hand the state of the current update to the external process; readers retry while it is being written
+ */
+void GazeboRosKobuki::writeSharedState(const common::Time& time_now)
+{
+  KobukiStateRecord record;
+  fillStateRecord(time_now, record);
+  shared_slot_->state.write(record);
+}
+
+/*
+ * Timing diagnostics: statistics of the window since the last publication, in microseconds per update
+ */
+void GazeboRosKobuki::updateTimingDiagnostics()
+{
+  diagnostics_->header.stamp = state_.update_stamp;
+  for (std::size_t i = 0; i < STAGE_COUNT; ++i)
   {
-    bumper_right_was_pressed_ = true;
-    bumper_event_.state = kobuki_msgs::BumperEvent::PRESSED;
-    bumper_event_.bumper = kobuki_msgs::BumperEvent::RIGHT;
-    bumper_event_pub_.publish(bumper_event_);
+    StageProfiler::Statistics statistics = profiler_->statistics(i);
+    std::vector<diagnostic_msgs::KeyValue>& values = diagnostics_->status[i].values;
+    values[0].value = std::to_string(statistics.count);
+    values[1].value = std::to_string(statistics.min);
+    values[2].value = std::to_string(statistics.mean);
+    values[3].value = std::to_string(statistics.p99);
+    values[4].value = std::to_string(statistics.max);
   }
-  else if (!bumper_right_is_pressed_ && bumper_right_was_pressed_)
+  diagnostics_->status[STAGE_VELOCITY_COMMANDS].values[5].value = std::to_string(joint_writes_);
+  joint_writes_ = 0;
+  profiler_->reset();
+  if (latency_tracer_)
   {
-    bumper_right_was_pressed_ = false;
-    bumper_event_.state = kobuki_msgs::BumperEvent::RELEASED;
-    bumper_event_.bumper = kobuki_msgs::BumperEvent::RIGHT;
-    bumper_event_pub_.publish(bumper_event_);
+    for (unsigned int i = 0; i < CommandLatencyTracer::MILESTONE_COUNT; ++i)
+    {
+      CommandLatencyTracer::Statistics statistics =
+        latency_tracer_->statistics(static_cast<CommandLatencyTracer::Milestone>(i));
+      std::vector<diagnostic_msgs::KeyValue>& values = diagnostics_->status[STAGE_COUNT + i].values;
+      values[0].value = std::to_string(statistics.wall.count);
+      values[1].value = std::to_string(statistics.wall.min);
+      values[2].value = std::to_string(statistics.wall.mean);
+      values[3].value = std::to_string(statistics.wall.p99);
+      values[4].value = std::to_string(statistics.wall.max);
+      values[5].value = std::to_string(statistics.mean_updates);
+      values[6].value = std::to_string(statistics.max_updates);
+    }
+    latency_tracer_->reset();
   }
+  state_.outbox |= OUT_DIAGNOSTICS;
 }
 }
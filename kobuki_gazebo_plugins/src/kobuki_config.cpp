@@ -0,0 +1,355 @@
+/*
+ * Copyright (c) 2013, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cmath>
+#include <limits>
+#include <sstream>
+#include "kobuki_gazebo_plugins/kobuki_config.h"
+
+namespace gazebo
+{
+
+static const double REQUIRED = std::numeric_limits<double>::quiet_NaN();
+
+KobukiConfig::KobukiConfig()
+  : wheel_separation(REQUIRED), wheel_diameter(REQUIRED), torque(REQUIRED), velocity_command_timeout(REQUIRED),
+    joint_motors(false), kinematic(false), wheel_acceleration_limit(0.0), wheel_deceleration_limit(0.0),
+    joint_velocity_tolerance(0.0),
+    odom_integrator(ODOM_INTEGRATOR_EULER), publish_tf(false), publish_tf_given(false), tf2(false),
+    tf_min_translation(0.0), tf_min_rotation(0.0),
+    joint_state_min_position_change(0.0), joint_state_min_velocity_change(0.0),
+    odom_min_position_change(0.0), odom_min_orientation_change(0.0), odom_min_linear_velocity_change(0.0),
+    odom_min_angular_velocity_change(0.0),
+    imu_min_orientation_change(0.0), imu_min_angular_velocity_change(0.0), imu_min_acceleration_change(0.0),
+    heartbeat_rate(1.0),
+    joint_state_rate(0.0), odom_rate(0.0), imu_rate(0.0), tf_rate(0.0), sensor_state_rate(0.0), core_sim_rate(0.0),
+    telemetry_rate(0.0),
+    timing_diagnostics_rate(0.0), latency_tracing(false), intra_process_publishing(false),
+    share_ros_resources(false), message_pool_size(4),
+    cliff_detection_threshold(REQUIRED), cliff_detection_hysteresis(0.0), skip_unchanged_sensors(true),
+    lazy_sensor_activation(false), floor_cache_cell_size(0.0), floor_cache_tolerance(0.005), floor_cache_samples(5),
+    floor_cache_margin(1), bumper_physics_contacts(false), lockstep(false),
+    battery_capacity(0.0), battery_base_current(0.5), battery_motor_current(1.0),
+    // one minute at Gazebo's default 1 kHz update rate
+    record_capacity(60000), shared_memory_capacity(256)
+{
+}
+
+bool KobukiConfig::parse(const sdf::ElementPtr& sdf, std::vector<std::string>& errors,
+                         std::vector<std::string>& warnings)
+{
+  static const char* sensor_labels[SENSOR_COUNT] = {"left", "center", "right"};
+  bool deceleration_given = false;
+  std::string integrator = "euler";
+  std::string actuation = "velocity";
+  std::string contact_source = "sensor";
+  std::string tf_broadcaster = "tf";
+  std::string sector_angles;
+
+  for (sdf::ElementPtr element = sdf->GetFirstElement(); element; element = element->GetNextElement())
+  {
+    const std::string name = element->GetName();
+    // drive
+    if (name == "left_wheel_joint_name")
+      left_wheel_joint_name = element->Get<std::string>();
+    else if (name == "right_wheel_joint_name")
+      right_wheel_joint_name = element->Get<std::string>();
+    else if (name == "wheel_separation")
+      wheel_separation = element->Get<double>();
+    else if (name == "wheel_diameter")
+      wheel_diameter = element->Get<double>();
+    else if (name == "torque")
+      torque = element->Get<double>();
+    else if (name == "velocity_command_timeout")
+      velocity_command_timeout = element->Get<double>();
+    else if (name == "wheel_actuation")
+      actuation = element->Get<std::string>();
+    else if (name == "wheel_acceleration_limit")
+      wheel_acceleration_limit = element->Get<double>();
+    else if (name == "wheel_deceleration_limit")
+    {
+      wheel_deceleration_limit = element->Get<double>();
+      deceleration_given = true;
+    }
+    else if (name == "joint_velocity_tolerance")
+      joint_velocity_tolerance = element->Get<double>();
+    // odometry
+    else if (name == "odom_integrator")
+      integrator = element->Get<std::string>();
+    else if (name == "publish_tf")
+    {
+      publish_tf = element->Get<bool>();
+      publish_tf_given = true;
+    }
+    else if (name == "tf_broadcaster")
+      tf_broadcaster = element->Get<std::string>();
+    else if (name == "tf_min_translation")
+      tf_min_translation = element->Get<double>();
+    else if (name == "tf_min_rotation")
+      tf_min_rotation = element->Get<double>();
+    else if (name == "joint_state_min_position_change")
+      joint_state_min_position_change = element->Get<double>();
+    else if (name == "joint_state_min_velocity_change")
+      joint_state_min_velocity_change = element->Get<double>();
+    else if (name == "odom_min_position_change")
+      odom_min_position_change = element->Get<double>();
+    else if (name == "odom_min_orientation_change")
+      odom_min_orientation_change = element->Get<double>();
+    else if (name == "odom_min_linear_velocity_change")
+      odom_min_linear_velocity_change = element->Get<double>();
+    else if (name == "odom_min_angular_velocity_change")
+      odom_min_angular_velocity_change = element->Get<double>();
+    else if (name == "imu_min_orientation_change")
+      imu_min_orientation_change = element->Get<double>();
+    else if (name == "imu_min_angular_velocity_change")
+      imu_min_angular_velocity_change = element->Get<double>();
+    else if (name == "imu_min_acceleration_change")
+      imu_min_acceleration_change = element->Get<double>();
+    else if (name == "heartbeat_rate")
+      heartbeat_rate = element->Get<double>();
+    // publishing
+    else if (name == "joint_state_rate")
+      joint_state_rate = element->Get<double>();
+    else if (name == "odom_rate")
+      odom_rate = element->Get<double>();
+    else if (name == "imu_rate")
+      imu_rate = element->Get<double>();
+    else if (name == "tf_rate")
+      tf_rate = element->Get<double>();
+    else if (name == "sensor_state_rate")
+      sensor_state_rate = element->Get<double>();
+    else if (name == "core_sim_rate")
+      core_sim_rate = element->Get<double>();
+    else if (name == "telemetry_rate")
+      telemetry_rate = element->Get<double>();
+    else if (name == "timing_diagnostics_rate")
+      timing_diagnostics_rate = element->Get<double>();
+    else if (name == "latency_tracing")
+      latency_tracing = element->Get<bool>();
+    else if (name == "intra_process_publishing")
+      intra_process_publishing = element->Get<bool>();
+    else if (name == "share_ros_resources")
+      share_ros_resources = element->Get<bool>();
+    else if (name == "message_pool_size")
+      message_pool_size = element->Get<int>();
+    // sensors
+    else if (name == "cliff_sensor_left_name")
+      cliff_sensor_names[SENSOR_LEFT] = element->Get<std::string>();
+    else if (name == "cliff_sensor_center_name")
+      cliff_sensor_names[SENSOR_CENTER] = element->Get<std::string>();
+    else if (name == "cliff_sensor_right_name")
+      cliff_sensor_names[SENSOR_RIGHT] = element->Get<std::string>();
+    else if (name == "cliff_detection_threshold")
+      cliff_detection_threshold = element->Get<double>();
+    else if (name == "cliff_detection_hysteresis")
+      cliff_detection_hysteresis = element->Get<double>();
+    else if (name == "skip_unchanged_sensors")
+      skip_unchanged_sensors = element->Get<bool>();
+    else if (name == "lazy_sensor_activation")
+      lazy_sensor_activation = element->Get<bool>();
+    else if (name == "floor_cache_cell_size")
+      floor_cache_cell_size = element->Get<double>();
+    else if (name == "floor_cache_tolerance")
+      floor_cache_tolerance = element->Get<double>();
+    else if (name == "floor_cache_samples")
+      floor_cache_samples = element->Get<int>();
+    else if (name == "floor_cache_margin")
+      floor_cache_margin = element->Get<int>();
+    else if (name == "bumper_name")
+      bumper_name = element->Get<std::string>();
+    else if (name == "bumper_sector_angles")
+      sector_angles = element->Get<std::string>();
+    else if (name == "bumper_contact_source")
+      contact_source = element->Get<std::string>();
+    else if (name == "imu_name")
+      imu_name = element->Get<std::string>();
+    // simulation
+    else if (name == "lockstep")
+      lockstep = element->Get<bool>();
+    else if (name == "encoder_quantisation")
+      noise.encoder_quantisation = element->Get<bool>();
+    else if (name == "wheel_slip_stddev")
+      noise.wheel_slip_stddev = element->Get<double>();
+    else if (name == "gyro_noise_stddev")
+      noise.gyro_noise_stddev = element->Get<double>();
+    else if (name == "gyro_bias")
+      noise.gyro_bias = element->Get<double>();
+    else if (name == "gyro_drift_stddev")
+      noise.gyro_drift_stddev = element->Get<double>();
+    else if (name == "noise_seed")
+    {
+      noise.seed = element->Get<unsigned int>();
+      noise.seeded = true;
+    }
+    else if (name == "battery_capacity")
+      battery_capacity = element->Get<double>();
+    else if (name == "battery_base_current")
+      battery_base_current = element->Get<double>();
+    else if (name == "battery_motor_current")
+      battery_motor_current = element->Get<double>();
+    else if (name == "record_file")
+      record_file = element->Get<std::string>();
+    else if (name == "record_capacity")
+      record_capacity = element->Get<int>();
+    else if (name == "shared_memory")
+      shared_memory = element->Get<std::string>();
+    else if (name == "shared_memory_capacity")
+      shared_memory_capacity = element->Get<int>();
+  }
+
+  /*
+   * Required parameters
+   */
+  if (left_wheel_joint_name.empty())
+    errors.push_back("Couldn't find the left wheel joint name (left_wheel_joint_name) in the model description! Did you specify it?");
+  if (right_wheel_joint_name.empty())
+    errors.push_back("Couldn't find the right wheel joint name (right_wheel_joint_name) in the model description! Did you specify it?");
+  if (std::isnan(wheel_separation))
+    errors.push_back("Couldn't find the wheel separation parameter in the model description! Did you specify it?");
+  else if (wheel_separation <= 0.0)
+    errors.push_back("The wheel separation has to be positive!");
+  if (std::isnan(wheel_diameter))
+    errors.push_back("Couldn't find the wheel diameter parameter in the model description! Did you specify it?");
+  else if (wheel_diameter <= 0.0)
+    errors.push_back("The wheel diameter has to be positive!");
+  if (std::isnan(torque))
+    errors.push_back("Couldn't find the torque parameter in the model description! Did you specify it?");
+  if (std::isnan(velocity_command_timeout))
+    errors.push_back("Couldn't find the velocity command timeout parameter in the model description! Did you specify it?");
+  for (unsigned int i = 0; i < SENSOR_COUNT; ++i)
+  {
+    if (cliff_sensor_names[i].empty())
+      errors.push_back(std::string("Couldn't find the name of ") + sensor_labels[i] + " cliff sensor"
+                       + " (cliff_sensor_" + sensor_labels[i] + "_name) in the model description! Did you specify it?");
+  }
+  if (std::isnan(cliff_detection_threshold))
+    errors.push_back("Couldn't find the cliff detection threshold parameter in the model description! Did you specify it?");
+  if (bumper_name.empty())
+    errors.push_back("Couldn't find the name of bumper sensor (bumper_name) in the model description! Did you specify it?");
+  if (imu_name.empty())
+    errors.push_back("Couldn't find the name of IMU sensor (imu_name) in the model description! Did you specify it?");
+
+  /*
+   * Optional parameters, falling back to their defaults
+   */
+  if (!deceleration_given)
+  {
+    wheel_deceleration_limit = wheel_acceleration_limit;
+  }
+  if (actuation == "motor")
+  {
+    joint_motors = true;
+  }
+  else if (actuation == "kinematic")
+  {
+    kinematic = true;
+  }
+  else if (actuation != "velocity")
+  {
+    warnings.push_back("Unknown wheel actuation '" + actuation + "', falling back to 'velocity'.");
+  }
+  if (integrator == "midpoint")
+  {
+    odom_integrator = ODOM_INTEGRATOR_MIDPOINT;
+  }
+  else if (integrator == "arc")
+  {
+    odom_integrator = ODOM_INTEGRATOR_ARC;
+  }
+  else if (integrator != "euler")
+  {
+    warnings.push_back("Unknown odometry integrator '" + integrator + "', falling back to 'euler'.");
+  }
+  if (tf_broadcaster == "tf2")
+  {
+    tf2 = true;
+  }
+  else if (tf_broadcaster != "tf")
+  {
+    warnings.push_back("Unknown tf broadcaster '" + tf_broadcaster + "', falling back to 'tf'.");
+  }
+  if (contact_source == "physics")
+  {
+    bumper_physics_contacts = true;
+  }
+  else if (contact_source != "sensor")
+  {
+    warnings.push_back("Unknown bumper contact source '" + contact_source + "', falling back to 'sensor'.");
+  }
+  if (!sector_angles.empty())
+  {
+    // boundaries in degrees, e.g. "90 30 -30 -90" for Kobuki's bumpers
+    std::istringstream angles(sector_angles);
+    double boundaries[SENSOR_COUNT + 1];
+    unsigned int count = 0;
+    while ((count <= SENSOR_COUNT) && (angles >> boundaries[count]))
+    {
+      boundaries[count] *= M_PI / 180.0;
+      ++count;
+    }
+    if ((count != SENSOR_COUNT + 1) || !bumper_sectors.setBoundaries(boundaries))
+    {
+      std::ostringstream warning;
+      warning << "Invalid bumper sector angles, expected " << SENSOR_COUNT + 1 << " descending angles"
+              << " with less than 180 degrees between neighbours. Using Kobuki's bumper sectors.";
+      warnings.push_back(warning.str());
+    }
+  }
+  if ((floor_cache_samples < 1) || (floor_cache_margin < 0))
+  {
+    warnings.push_back("Invalid floor cache samples (" + std::to_string(floor_cache_samples) + ") or margin ("
+                       + std::to_string(floor_cache_margin) + "), using 5 and 1 instead.");
+    floor_cache_samples = 5;
+    floor_cache_margin = 1;
+  }
+  if (message_pool_size < 1)
+  {
+    warnings.push_back("Invalid message pool size (" + std::to_string(message_pool_size) + "), using 1 instead.");
+    message_pool_size = 1;
+  }
+  if (record_capacity < 1)
+  {
+    warnings.push_back("Invalid record capacity (" + std::to_string(record_capacity) + "), using 60000 instead.");
+    record_capacity = 60000;
+  }
+  if (!shared_memory.empty() && shared_memory[0] != '/')
+  {
+    // POSIX shared memory objects are named like "/name"
+    shared_memory = "/" + shared_memory;
+  }
+  if (shared_memory_capacity < 1)
+  {
+    warnings.push_back("Invalid shared memory capacity (" + std::to_string(shared_memory_capacity)
+                       + "), using 256 instead.");
+    shared_memory_capacity = 256;
+  }
+  return errors.empty();
+}
+
+} // namespace gazebo
@@ -0,0 +1,289 @@
+/*
+ * Copyright (c) 2013, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <algorithm>
+#include <boost/bind.hpp>
+#include "kobuki_gazebo_plugins/kobuki_fleet.h"
+#include "kobuki_gazebo_plugins/gazebo_ros_kobuki.h"
+
+namespace gazebo
+{
+
+/// Number of robots a worker processes in one go
+static const std::size_t ROBOTS_PER_CHUNK = 4;
+
+void KobukiFleetBatch::resize(std::size_t size)
+{
+  step.resize(size);
+  drive_model.resize(size);
+  wheel_vel[LEFT].resize(size);
+  wheel_vel[RIGHT].resize(size);
+  yaw_rate.resize(size);
+  odom_x.resize(size);
+  odom_y.resize(size);
+  odom_yaw.resize(size);
+  odom_linear_vel.resize(size);
+  odom_angular_vel.resize(size);
+  odom_nan_flags.resize(size);
+  for (unsigned int k = 0; k < SENSOR_COUNT; ++k)
+  {
+    cliff_range[k].resize(size);
+  }
+  cliff_threshold.resize(size);
+  cliff_hysteresis.resize(size);
+  cliff_state.resize(size);
+  bumper_state.resize(size);
+}
+
+KobukiFleet& KobukiFleet::instance()
+{
+  static KobukiFleet fleet;
+  return fleet;
+}
+
+KobukiFleet::KobukiFleet() : tf_broadcaster_(NULL), transforms_due_(false) {}
+
+bool KobukiFleet::start(physics::WorldPtr world, unsigned int worker_threads)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  if (world_)
+  {
+    gzerr << "The Kobuki fleet manager is already running, ignoring the second one.\n";
+    return false;
+  }
+  world_ = world;
+  workers_.reset(new WorkerPool(worker_threads));
+  update_connection_ = event::Events::ConnectWorldUpdateEnd(boost::bind(&KobukiFleet::OnUpdate, this));
+  gzdbg << "Kobuki fleet manager started with " << worker_threads << " worker threads.\n";
+  return true;
+}
+
+void KobukiFleet::stop()
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  update_connection_.reset();
+  world_.reset();
+  workers_.reset();
+  tf_broadcaster_ = NULL;
+  ros_resources_.reset();
+  if (!robots_.empty())
+  {
+    gzwarn << "Kobuki fleet manager stopped with " << robots_.size() << " robots still registered.\n";
+  }
+  robots_.clear();
+  batch_.resize(0);
+}
+
+bool KobukiFleet::batchTransforms(double rate)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  if (!world_ || !ros::isInitialized())
+  {
+    gzerr << "Can't batch the Kobuki transforms without a running fleet manager and ROS node.\n";
+    return false;
+  }
+  ros_resources_ = RosResources::shared();
+  tf_broadcaster_ = &ros_resources_->tf2Broadcaster();
+  tf_schedule_.setRate(rate);
+  // robots registered so far stopped sending their own transforms
+  for (std::size_t i = 0; i < robots_.size(); ++i)
+  {
+    robots_[i]->state_.tf_batched = true;
+  }
+  gzdbg << "Kobuki fleet manager batches the odom transforms at " << rate << " Hz.\n";
+  return true;
+}
+
+bool KobukiFleet::add(GazeboRosKobuki* robot)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  if (!world_)
+  {
+    return false;
+  }
+  robots_.push_back(robot);
+  batch_.resize(robots_.size());
+  transforms_.reserve(robots_.size());
+  robot->state_.tf_batched = (tf_broadcaster_ != NULL);
+  return true;
+}
+
+void KobukiFleet::remove(GazeboRosKobuki* robot)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  robots_.erase(std::remove(robots_.begin(), robots_.end(), robot), robots_.end());
+  batch_.resize(robots_.size());
+}
+
+void KobukiFleet::OnUpdate()
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  if (robots_.empty())
+  {
+    return;
+  }
+  // one time stamp for all robots of this update
+  common::Time time_now = api::simTime(*world_);
+
+  // taking over the commands may switch the robots' sensors, which Gazebo doesn't allow from other threads
+  for (std::size_t i = 0; i < robots_.size(); ++i)
+  {
+    batch_.step[i] = robots_[i]->beginUpdate(time_now).Double();
+  }
+  transforms_due_ = tf_broadcaster_ && tf_schedule_.due(time_now);
+  // robots are independent of each other until publishing
+  workers_->parallelFor(robots_.size(), ROBOTS_PER_CHUNK,
+                        boost::bind(&KobukiFleet::process, this, boost::cref(time_now), _1, _2));
+  publish();
+}
+
+void KobukiFleet::process(const common::Time& time_now, std::size_t begin, std::size_t end)
+{
+  gather(begin, end);
+  compute(begin, end);
+  scatter(begin, end);
+  fill(time_now, begin, end);
+}
+
+void KobukiFleet::gather(std::size_t begin, std::size_t end)
+{
+  for (std::size_t i = begin; i < end; ++i)
+  {
+    GazeboRosKobuki& robot = *robots_[i];
+    robot.readSensors(common::Time(batch_.step[i]));
+    batch_.drive_model[i] = robot.drive_model_;
+    batch_.wheel_vel[LEFT][i] = robot.state_.wheel_vel[LEFT];
+    batch_.wheel_vel[RIGHT][i] = robot.state_.wheel_vel[RIGHT];
+    batch_.yaw_rate[i] = robot.yawRate();
+    batch_.odom_x[i] = robot.state_.odom_pose[0];
+    batch_.odom_y[i] = robot.state_.odom_pose[1];
+    batch_.odom_yaw[i] = robot.state_.odom_pose[2];
+    for (unsigned int k = 0; k < SENSOR_COUNT; ++k)
+    {
+      batch_.cliff_range[k][i] = robot.state_.cliff_range[k];
+    }
+    batch_.cliff_threshold[i] = robot.state_.cliff_detection_threshold;
+    batch_.cliff_hysteresis[i] = robot.state_.cliff_detection_hysteresis;
+    batch_.cliff_state[i] = robot.state_.cliff_state;
+    batch_.bumper_state[i] = robot.bumperState();
+  }
+}
+
+/*
+ * Same math as GazeboRosKobuki::OnUpdate, but over contiguous arrays
+ */
+void KobukiFleet::compute(std::size_t begin, std::size_t end)
+{
+  for (std::size_t i = begin; i < end; ++i)
+  {
+    batch_.odom_nan_flags[i] = batch_.drive_model[i].integrate(batch_.step[i],
+                                                               batch_.wheel_vel[LEFT][i], batch_.wheel_vel[RIGHT][i],
+                                                               batch_.yaw_rate[i],
+                                                               batch_.odom_x[i], batch_.odom_y[i], batch_.odom_yaw[i],
+                                                               batch_.odom_linear_vel[i], batch_.odom_angular_vel[i]);
+  }
+  for (std::size_t i = begin; i < end; ++i)
+  {
+    double range[SENSOR_COUNT] = {batch_.cliff_range[SENSOR_LEFT][i],
+                                  batch_.cliff_range[SENSOR_CENTER][i],
+                                  batch_.cliff_range[SENSOR_RIGHT][i]};
+    batch_.cliff_state[i] = classifyCliffs(range, batch_.cliff_state[i],
+                                           batch_.cliff_threshold[i], batch_.cliff_hysteresis[i]);
+  }
+}
+
+void KobukiFleet::scatter(std::size_t begin, std::size_t end)
+{
+  for (std::size_t i = begin; i < end; ++i)
+  {
+    GazeboRosKobuki& robot = *robots_[i];
+    robot.state_.odom_pose[0] = batch_.odom_x[i];
+    robot.state_.odom_pose[1] = batch_.odom_y[i];
+    robot.state_.odom_pose[2] = batch_.odom_yaw[i];
+    robot.state_.odom_vel[0] = batch_.odom_linear_vel[i];
+    robot.state_.odom_vel[1] = 0.0;
+    robot.state_.odom_vel[2] = batch_.odom_angular_vel[i];
+    robot.state_.cliff_state = batch_.cliff_state[i];
+  }
+}
+
+/*
+ * Build the robots' messages (and the batched transforms, robots whose pose didn't change by their tf
+ * thresholds are left out)
+ */
+void KobukiFleet::fill(const common::Time& time_now, std::size_t begin, std::size_t end)
+{
+  for (std::size_t i = begin; i < end; ++i)
+  {
+    GazeboRosKobuki& robot = *robots_[i];
+    robot.fillMessages(time_now);
+    if (transforms_due_ && robot.state_.publish_tf && robot.fillTf())
+    {
+      robot.state_.outbox |= GazeboRosKobuki::OUT_TF;
+    }
+  }
+}
+
+/*
+ * Publishing happens in a separate pass on the update thread, after all robots' messages are built; so do
+ * the joint writes and the warnings. Every robot publishes on its own publishers, only the transforms are
+ * combined into one message
+ */
+void KobukiFleet::publish()
+{
+  for (std::size_t i = 0; i < robots_.size(); ++i)
+  {
+    GazeboRosKobuki& robot = *robots_[i];
+    robot.warnOdometryNaN(batch_.odom_nan_flags[i], common::Time(batch_.step[i]));
+    robot.publishMessages();
+  }
+  if (transforms_due_)
+  {
+    publishTransforms();
+  }
+}
+
+void KobukiFleet::publishTransforms()
+{
+  transforms_.clear();
+  for (std::size_t i = 0; i < robots_.size(); ++i)
+  {
+    GazeboRosKobuki& robot = *robots_[i];
+    if (robot.state_.tf_batched && (robot.state_.outbox & GazeboRosKobuki::OUT_TF))
+    {
+      transforms_.push_back(robot.odom_tf_);
+    }
+  }
+  if (!transforms_.empty())
+  {
+    tf_broadcaster_->sendTransform(transforms_);
+  }
+}
+
+} // namespace gazebo
@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2013, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Streams a record file written by the Kobuki plugin (<record_file>) back to the plugin's topics.
+ *
+ * Usage: kobuki_state_replay <record file> [speed]
+ *   speed: replay speed relative to simulation time (default 1), 0 replays as fast as possible
+ * Parameters (private): base_prefix, publish_tf, left_wheel_joint_name, right_wheel_joint_name
+ */
+
+#include <atomic>
+#include <cstdlib>
+#include <string>
+#include <ros/ros.h>
+#include <sensor_msgs/Imu.h>
+#include <sensor_msgs/JointState.h>
+#include <nav_msgs/Odometry.h>
+#include <geometry_msgs/TransformStamped.h>
+#include <tf/transform_broadcaster.h>
+#include <tf/LinearMath/Quaternion.h>
+#include <kobuki_msgs/BumperEvent.h>
+#include <kobuki_msgs/CliffEvent.h>
+#include "kobuki_gazebo_plugins/kobuki_model.h"
+#include "kobuki_gazebo_plugins/state_record_file.h"
+
+using namespace gazebo;
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "kobuki_state_replay");
+  if (argc < 2)
+  {
+    ROS_ERROR_STREAM("Usage: kobuki_state_replay <record file> [speed]");
+    return 1;
+  }
+  std::string record_file = argv[1];
+  double speed = (argc > 2) ? std::atof(argv[2]) : 1.0;
+
+  ros::NodeHandle nh, nh_priv("~");
+  std::string base_prefix, left_wheel_joint_name, right_wheel_joint_name;
+  bool publish_tf;
+  nh_priv.param("base_prefix", base_prefix, std::string("mobile_base"));
+  nh_priv.param("publish_tf", publish_tf, true);
+  nh_priv.param("left_wheel_joint_name", left_wheel_joint_name, std::string("wheel_left_joint"));
+  nh_priv.param("right_wheel_joint_name", right_wheel_joint_name, std::string("wheel_right_joint"));
+
+  StateRecordFile file;
+  if (!file.open(record_file))
+  {
+    ROS_ERROR_STREAM("Couldn't open the record file '" << record_file << "'.");
+    return 1;
+  }
+  uint64_t end = file.count();
+  uint64_t begin = (end > file.capacity()) ? end - file.capacity() : 0;
+  ROS_INFO_STREAM("Replaying " << end - begin << " records from '" << record_file << "' at speed " << speed << ".");
+
+  ros::Publisher joint_state_pub = nh.advertise<sensor_msgs::JointState>("joint_states", 1);
+  ros::Publisher odom_pub = nh.advertise<nav_msgs::Odometry>("odom", 1);
+  ros::Publisher imu_pub = nh.advertise<sensor_msgs::Imu>(base_prefix + "/sensors/imu_data", 1);
+  ros::Publisher cliff_event_pub = nh.advertise<kobuki_msgs::CliffEvent>(base_prefix + "/events/cliff", 1);
+  ros::Publisher bumper_event_pub = nh.advertise<kobuki_msgs::BumperEvent>(base_prefix + "/events/bumper", 1);
+  tf::TransformBroadcaster tf_broadcaster;
+
+  // the same invariant fields as published by the plugin
+  sensor_msgs::JointState joint_state;
+  joint_state.header.frame_id = "base_link";
+  joint_state.name.push_back(left_wheel_joint_name);
+  joint_state.name.push_back(right_wheel_joint_name);
+  joint_state.position.resize(2);
+  joint_state.velocity.resize(2);
+  joint_state.effort.resize(2);
+  nav_msgs::Odometry odom;
+  odom.header.frame_id = "odom";
+  odom.child_frame_id = "base_footprint";
+  odom.pose.covariance[0]  = 0.1;
+  odom.pose.covariance[7]  = 0.1;
+  odom.pose.covariance[35] = 0.05;
+  odom.pose.covariance[14] = 1e6;
+  odom.pose.covariance[21] = 1e6;
+  odom.pose.covariance[28] = 1e6;
+  geometry_msgs::TransformStamped odom_tf;
+  odom_tf.header.frame_id = "odom";
+  odom_tf.child_frame_id = "base_footprint";
+  sensor_msgs::Imu imu_msg;
+  imu_msg.header.frame_id = "base_link";
+  imu_msg.orientation_covariance[0] = 1e6;
+  imu_msg.orientation_covariance[4] = 1e6;
+  imu_msg.orientation_covariance[8] = 0.05;
+  imu_msg.angular_velocity_covariance[0] = 1e6;
+  imu_msg.angular_velocity_covariance[4] = 1e6;
+  imu_msg.angular_velocity_covariance[8] = 0.05;
+  kobuki_msgs::CliffEvent cliff_event;
+  kobuki_msgs::BumperEvent bumper_event;
+
+  unsigned int cliff_state = 0, bumper_state = 0;
+  ros::WallTime wall_start = ros::WallTime::now();
+  ros::Time sim_start;
+  bool started = false;
+  uint64_t overwritten = 0;
+  for (uint64_t n = begin; (n < end) && ros::ok(); ++n)
+  {
+    // copy, the writer may still be overwriting the oldest records: record n's slot is taken by record
+    // n + capacity, which is being written as soon as the count reaches n + capacity
+    KobukiStateRecord record = file.record(n);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (file.count() >= n + file.capacity())
+    {
+      ++overwritten;
+      continue;
+    }
+    ros::Time stamp(record.sim_sec, record.sim_nsec);
+    if (!started)
+    {
+      sim_start = stamp;
+      started = true;
+    }
+    if (speed > 0.0)
+    {
+      ros::WallTime due = wall_start + ros::WallDuration((stamp - sim_start).toSec() / speed);
+      ros::WallDuration wait = due - ros::WallTime::now();
+      if (wait > ros::WallDuration(0))
+      {
+        wait.sleep();
+      }
+    }
+
+    joint_state.header.stamp = stamp;
+    for (unsigned int side = 0; side < 2; ++side)
+    {
+      joint_state.position[side] = record.wheel_position[side];
+      joint_state.velocity[side] = record.wheel_velocity[side];
+    }
+    joint_state_pub.publish(joint_state);
+
+    tf::Quaternion qt;
+    qt.setEuler(0, 0, record.odom_pose[2]);
+    odom.header.stamp = stamp;
+    odom.pose.pose.position.x = record.odom_pose[0];
+    odom.pose.pose.position.y = record.odom_pose[1];
+    odom.pose.pose.orientation.x = qt.getX();
+    odom.pose.pose.orientation.y = qt.getY();
+    odom.pose.pose.orientation.z = qt.getZ();
+    odom.pose.pose.orientation.w = qt.getW();
+    odom.twist.twist.linear.x = record.odom_linear_vel;
+    odom.twist.twist.angular.z = record.odom_angular_vel;
+    odom_pub.publish(odom);
+    if (publish_tf)
+    {
+      odom_tf.header.stamp = stamp;
+      odom_tf.transform.translation.x = record.odom_pose[0];
+      odom_tf.transform.translation.y = record.odom_pose[1];
+      odom_tf.transform.rotation = odom.pose.pose.orientation;
+      tf_broadcaster.sendTransform(odom_tf);
+    }
+
+    imu_msg.header.stamp = stamp;
+    imu_msg.orientation.x = record.imu_orientation[0];
+    imu_msg.orientation.y = record.imu_orientation[1];
+    imu_msg.orientation.z = record.imu_orientation[2];
+    imu_msg.orientation.w = record.imu_orientation[3];
+    imu_msg.angular_velocity.x = record.imu_angular_vel[0];
+    imu_msg.angular_velocity.y = record.imu_angular_vel[1];
+    imu_msg.angular_velocity.z = record.imu_angular_vel[2];
+    imu_msg.linear_acceleration.x = record.imu_linear_acc[0];
+    imu_msg.linear_acceleration.y = record.imu_linear_acc[1];
+    imu_msg.linear_acceleration.z = record.imu_linear_acc[2];
+    imu_pub.publish(imu_msg);
+
+    // events for the state changes, just as the plugin signals them
+    for (unsigned int i = 0; i < SENSOR_COUNT; ++i)
+    {
+      unsigned int bit = 1u << i;
+      if ((record.cliff_state ^ cliff_state) & bit)
+      {
+        cliff_event.sensor = i;
+        cliff_event.state = (record.cliff_state & bit) ? kobuki_msgs::CliffEvent::CLIFF
+                                                       : kobuki_msgs::CliffEvent::FLOOR;
+        cliff_event.bottom = CliffADTable::instance()(record.cliff_range[i]);
+        cliff_event_pub.publish(cliff_event);
+      }
+      if ((record.bumper_state ^ bumper_state) & bit)
+      {
+        bumper_event.bumper = i;
+        bumper_event.state = (record.bumper_state & bit) ? kobuki_msgs::BumperEvent::PRESSED
+                                                         : kobuki_msgs::BumperEvent::RELEASED;
+        bumper_event_pub.publish(bumper_event);
+      }
+    }
+    cliff_state = record.cliff_state;
+    bumper_state = record.bumper_state;
+  }
+  if (overwritten > 0)
+  {
+    ROS_WARN_STREAM("Skipped " << overwritten << " records overwritten by the writer before they were replayed.");
+  }
+  return 0;
+}
@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2013, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <boost/weak_ptr.hpp>
+#include "kobuki_gazebo_plugins/ros_resources.h"
+
+namespace gazebo
+{
+
+/// Resources of the plugin instances sharing them
+static boost::mutex shared_mutex;
+static boost::weak_ptr<RosResources> shared_resources;
+
+RosResources::RosResources() : shutdown_requested_(false) {}
+
+RosResources::~RosResources()
+{
+  shutdown_requested_ = true;
+  callback_queue_.disable();
+  callback_queue_.clear();
+  step_queue_.disable();
+  step_queue_.clear();
+  if (spinner_thread_)
+  {
+    spinner_thread_->join();
+  }
+  if (step_spinner_thread_)
+  {
+    step_spinner_thread_->join();
+  }
+}
+
+boost::shared_ptr<RosResources> RosResources::shared()
+{
+  boost::mutex::scoped_lock lock(shared_mutex);
+  boost::shared_ptr<RosResources> resources = shared_resources.lock();
+  if (!resources)
+  {
+    resources.reset(new RosResources());
+    shared_resources = resources;
+  }
+  return resources;
+}
+
+void RosResources::startSpinner()
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  if (!spinner_thread_)
+  {
+    spinner_thread_.reset(new boost::thread(boost::bind(&RosResources::spin, this, &callback_queue_)));
+  }
+}
+
+void RosResources::startStepSpinner()
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  if (!step_spinner_thread_)
+  {
+    step_spinner_thread_.reset(new boost::thread(boost::bind(&RosResources::spin, this, &step_queue_)));
+  }
+}
+
+void RosResources::spin(ros::CallbackQueue* queue)
+{
+  while (ros::ok() && !shutdown_requested_)
+  {
+    queue->callAvailable(ros::WallDuration(0.01));
+  }
+}
+
+tf::TransformBroadcaster& RosResources::tfBroadcaster()
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  if (!tf_broadcaster_)
+  {
+    tf_broadcaster_.reset(new tf::TransformBroadcaster());
+  }
+  return *tf_broadcaster_;
+}
+
+tf2_ros::TransformBroadcaster& RosResources::tf2Broadcaster()
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  if (!tf2_broadcaster_)
+  {
+    tf2_broadcaster_.reset(new tf2_ros::TransformBroadcaster());
+  }
+  return *tf2_broadcaster_;
+}
+
+/*
+ * The thread objects and broadcasters allocated so far; what the threads, queues and broadcasters keep inside
+ * roscpp and boost isn't visible from here
+ */
+std::size_t RosResources::memoryUsage() const
+{
+  std::size_t usage = 0;
+  if (spinner_thread_)
+  {
+    usage += sizeof(boost::thread);
+  }
+  if (step_spinner_thread_)
+  {
+    usage += sizeof(boost::thread);
+  }
+  if (tf_broadcaster_)
+  {
+    usage += sizeof(tf::TransformBroadcaster);
+  }
+  if (tf2_broadcaster_)
+  {
+    usage += sizeof(tf2_ros::TransformBroadcaster);
+  }
+  return usage;
+}
+
+unsigned int RosResources::spinnerThreads() const
+{
+  return (spinner_thread_ ? 1 : 0) + (step_spinner_thread_ ? 1 : 0);
+}
+
+} // namespace gazebo
@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2013, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cstring>
+#include <map>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <boost/thread/mutex.hpp>
+#include <boost/weak_ptr.hpp>
+#include "kobuki_gazebo_plugins/shared_state_segment.h"
+
+namespace gazebo
+{
+
+static const char SHARED_STATE_MAGIC[8] = {'K', 'O', 'B', 'U', 'K', 'I', 'S', 'M'};
+static const uint32_t SHARED_STATE_VERSION = 1;
+
+/// Segments mapped by this process, shared by all robots using the same name
+static boost::mutex segments_mutex;
+static std::map<std::string, boost::weak_ptr<SharedStateSegment> > segments;
+
+boost::shared_ptr<SharedStateSegment> SharedStateSegment::open(const std::string& name, std::size_t capacity)
+{
+  boost::mutex::scoped_lock lock(segments_mutex);
+  boost::shared_ptr<SharedStateSegment> segment = segments[name].lock();
+  if (!segment)
+  {
+    segment.reset(new SharedStateSegment(name));
+    if (!segment->create(capacity))
+    {
+      segments.erase(name);
+      return boost::shared_ptr<SharedStateSegment>();
+    }
+    segments[name] = segment;
+  }
+  return segment;
+}
+
+SharedStateSegment::SharedStateSegment(const std::string& name)
+  : name_(name), header_(NULL), slots_(NULL), mapped_size_(0) {}
+
+SharedStateSegment::~SharedStateSegment()
+{
+  if (header_)
+  {
+    ::munmap(header_, mapped_size_);
+    ::shm_unlink(name_.c_str());
+  }
+}
+
+/*
+ * A segment left over by a previous simulation is replaced, its slots would belong to robots that are gone
+ */
+bool SharedStateSegment::create(std::size_t capacity)
+{
+  if (capacity == 0)
+  {
+    return false;
+  }
+  ::shm_unlink(name_.c_str());
+  int fd = ::shm_open(name_.c_str(), O_RDWR | O_CREAT | O_EXCL, 0666);
+  if (fd < 0)
+  {
+    return false;
+  }
+  std::size_t size = sizeof(Header) + capacity * sizeof(KobukiSharedSlot);
+  void* address = MAP_FAILED;
+  if (::ftruncate(fd, size) == 0)
+  {
+    address = ::mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  ::close(fd);
+  if (address == MAP_FAILED)
+  {
+    ::shm_unlink(name_.c_str());
+    return false;
+  }
+  // the new segment is zero filled, i.e. all slots are free and all sequences even
+  header_ = static_cast<Header*>(address);
+  slots_ = reinterpret_cast<KobukiSharedSlot*>(static_cast<char*>(address) + sizeof(Header));
+  mapped_size_ = size;
+  std::memcpy(header_->magic, SHARED_STATE_MAGIC, sizeof(SHARED_STATE_MAGIC));
+  header_->version = SHARED_STATE_VERSION;
+  header_->slot_size = sizeof(KobukiSharedSlot);
+  header_->capacity = capacity;
+  header_->slot_count.store(0, std::memory_order_release);
+  return true;
+}
+
+/*
+ * Only called by the plugins of this process (under segments_mutex), external processes merely read in_use
+ */
+KobukiSharedSlot* SharedStateSegment::claim(const std::string& robot_name)
+{
+  boost::mutex::scoped_lock lock(segments_mutex);
+  for (std::size_t i = 0; i < header_->capacity; ++i)
+  {
+    KobukiSharedSlot& slot = slots_[i];
+    if (slot.in_use.load(std::memory_order_relaxed) != 0)
+    {
+      continue;
+    }
+    std::strncpy(slot.robot_name, robot_name.c_str(), sizeof(slot.robot_name) - 1);
+    slot.robot_name[sizeof(slot.robot_name) - 1] = '\0';
+    slot.in_use.store(1, std::memory_order_release);
+    if (i >= header_->slot_count.load(std::memory_order_relaxed))
+    {
+      header_->slot_count.store(i + 1, std::memory_order_release);
+    }
+    return &slot;
+  }
+  return NULL;
+}
+
+void SharedStateSegment::release(KobukiSharedSlot* slot)
+{
+  boost::mutex::scoped_lock lock(segments_mutex);
+  slot->in_use.store(0, std::memory_order_release);
+}
+
+std::size_t SharedStateSegment::capacity() const
+{
+  return header_ ? header_->capacity : 0;
+}
+
+} // namespace gazebo
@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2013, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include "kobuki_gazebo_plugins/stage_profiler.h"
+
+namespace gazebo
+{
+
+StageProfiler::StageProfiler(std::size_t stages) : histograms_(stages), pending_(stages, 0), ran_(stages, false)
+{
+  reset();
+}
+
+void StageProfiler::commit()
+{
+  for (std::size_t i = 0; i < histograms_.size(); ++i)
+  {
+    if (ran_[i])
+    {
+      add(i, pending_[i]);
+      pending_[i] = 0;
+      ran_[i] = false;
+    }
+  }
+}
+
+void StageProfiler::add(std::size_t stage, uint64_t nsec)
+{
+  Histogram& histogram = histograms_[stage];
+  ++histogram.count;
+  histogram.sum += nsec;
+  histogram.min = std::min(histogram.min, nsec);
+  histogram.max = std::max(histogram.max, nsec);
+  ++histogram.buckets[bucket(nsec)];
+}
+
+StageProfiler::Statistics StageProfiler::statistics(std::size_t stage) const
+{
+  const Histogram& histogram = histograms_[stage];
+  Statistics statistics;
+  statistics.count = histogram.count;
+  if (histogram.count == 0)
+  {
+    statistics.min = statistics.mean = statistics.p99 = statistics.max = 0.0;
+    return statistics;
+  }
+  // the 99th percentile is reported as the upper bound of the bucket it falls into
+  uint64_t rank = (histogram.count * 99 + 99) / 100;
+  uint64_t seen = 0;
+  uint64_t p99 = histogram.max;
+  for (std::size_t i = 0; i < BUCKETS; ++i)
+  {
+    seen += histogram.buckets[i];
+    if (seen >= rank)
+    {
+      p99 = std::min(bucketUpperBound(i), histogram.max);
+      break;
+    }
+  }
+  statistics.min = histogram.min * 1e-3;
+  statistics.mean = histogram.sum * 1e-3 / histogram.count;
+  statistics.p99 = p99 * 1e-3;
+  statistics.max = histogram.max * 1e-3;
+  return statistics;
+}
+
+void StageProfiler::reset()
+{
+  for (std::size_t i = 0; i < histograms_.size(); ++i)
+  {
+    std::memset(&histograms_[i], 0, sizeof(Histogram));
+    histograms_[i].min = std::numeric_limits<uint64_t>::max();
+  }
+}
+
+/*
+ * Values below 4 get their own bucket, above that each power of two [2^e, 2^(e+1)) is split into
+ * four buckets.
+ */
+std::size_t StageProfiler::bucket(uint64_t nsec)
+{
+  if (nsec < 4)
+    return nsec;
+  unsigned int exponent = 63 - __builtin_clzll(nsec);
+  unsigned int sub_bucket = (nsec >> (exponent - 2)) & 3;
+  return 4 * (exponent - 1) + sub_bucket;
+}
+
+uint64_t StageProfiler::bucketUpperBound(std::size_t bucket)
+{
+  if (bucket < 4)
+    return bucket;
+  unsigned int exponent = bucket / 4 + 1;
+  uint64_t sub_bucket = bucket % 4;
+  if (exponent >= 63 && sub_bucket == 3)
+    return std::numeric_limits<uint64_t>::max();
+  return ((4 + sub_bucket + 1) << (exponent - 2)) - 1;
+}
+
+} // namespace gazebo
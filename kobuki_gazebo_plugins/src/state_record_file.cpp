@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2013, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cstring>
+#include <mutex>
+#include <set>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "kobuki_gazebo_plugins/state_record_file.h"
+
+namespace gazebo
+{
+
+static const char STATE_RECORD_MAGIC[8] = {'K', 'O', 'B', 'U', 'K', 'I', 'S', 'R'};
+static const uint32_t STATE_RECORD_VERSION = 1;
+
+/*
+ * Paths the record files of this process write to, so two writers don't truncate each other's ring
+ */
+static std::mutex write_paths_mutex;
+static std::set<std::string> write_paths;
+
+StateRecordFile::StateRecordFile() : header_(NULL), records_(NULL), mapped_size_(0) {}
+
+StateRecordFile::~StateRecordFile()
+{
+  close();
+}
+
+bool StateRecordFile::create(const std::string& path, std::size_t capacity)
+{
+  close();
+  if (capacity == 0)
+  {
+    return false;
+  }
+  {
+    std::lock_guard<std::mutex> lock(write_paths_mutex);
+    if (!write_paths.insert(path).second)
+    {
+      return false;
+    }
+  }
+  write_path_ = path;
+  int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+  {
+    close();
+    return false;
+  }
+  std::size_t size = sizeof(Header) + capacity * sizeof(KobukiStateRecord);
+  if ((::ftruncate(fd, size) != 0) || !map(fd, size, true))
+  {
+    ::close(fd);
+    close();
+    return false;
+  }
+  ::close(fd);
+  std::memcpy(header_->magic, STATE_RECORD_MAGIC, sizeof(STATE_RECORD_MAGIC));
+  header_->version = STATE_RECORD_VERSION;
+  header_->record_size = sizeof(KobukiStateRecord);
+  header_->capacity = capacity;
+  header_->count.store(0, std::memory_order_release);
+  return true;
+}
+
+bool StateRecordFile::open(const std::string& path)
+{
+  close();
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    return false;
+  }
+  struct stat file_stat;
+  if ((::fstat(fd, &file_stat) != 0) || ((std::size_t)file_stat.st_size < sizeof(Header))
+      || !map(fd, file_stat.st_size, false))
+  {
+    ::close(fd);
+    return false;
+  }
+  ::close(fd);
+  // reject files of other versions or builds with another record layout, and rings without (room for) records
+  if ((std::memcmp(header_->magic, STATE_RECORD_MAGIC, sizeof(STATE_RECORD_MAGIC)) != 0)
+      || (header_->version != STATE_RECORD_VERSION) || (header_->record_size != sizeof(KobukiStateRecord))
+      || (header_->capacity == 0)
+      || (header_->capacity > (mapped_size_ - sizeof(Header)) / sizeof(KobukiStateRecord)))
+  {
+    close();
+    return false;
+  }
+  return true;
+}
+
+bool StateRecordFile::map(int fd, std::size_t size, bool writable)
+{
+  void* address = ::mmap(NULL, size, writable ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, fd, 0);
+  if (address == MAP_FAILED)
+  {
+    return false;
+  }
+  header_ = static_cast<Header*>(address);
+  records_ = reinterpret_cast<KobukiStateRecord*>(static_cast<char*>(address) + sizeof(Header));
+  mapped_size_ = size;
+  return true;
+}
+
+void StateRecordFile::close()
+{
+  if (header_)
+  {
+    ::munmap(header_, mapped_size_);
+  }
+  header_ = NULL;
+  records_ = NULL;
+  mapped_size_ = 0;
+  if (!write_path_.empty())
+  {
+    std::lock_guard<std::mutex> lock(write_paths_mutex);
+    write_paths.erase(write_path_);
+    write_path_.clear();
+  }
+}
+
+std::size_t StateRecordFile::capacity() const
+{
+  return header_ ? header_->capacity : 0;
+}
+
+uint64_t StateRecordFile::count() const
+{
+  return header_ ? header_->count.load(std::memory_order_acquire) : 0;
+}
+
+void StateRecordFile::append(const KobukiStateRecord& record)
+{
+  uint64_t n = header_->count.load(std::memory_order_relaxed);
+  records_[n % header_->capacity] = record;
+  header_->count.store(n + 1, std::memory_order_release);
+}
+
+const KobukiStateRecord& StateRecordFile::record(uint64_t n) const
+{
+  return records_[n % header_->capacity];
+}
+
+} // namespace gazebo
@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2013, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <algorithm>
+#include <boost/bind.hpp>
+#include "kobuki_gazebo_plugins/worker_pool.h"
+
+namespace gazebo
+{
+
+WorkerPool::WorkerPool(unsigned int threads)
+  : task_(NULL), count_(0), grain_(1), next_(0), generation_(0), busy_(0), shutdown_(false)
+{
+  for (unsigned int i = 0; i < threads; ++i)
+  {
+    threads_.create_thread(boost::bind(&WorkerPool::work, this));
+  }
+}
+
+WorkerPool::~WorkerPool()
+{
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    shutdown_ = true;
+  }
+  start_condition_.notify_all();
+  threads_.join_all();
+}
+
+void WorkerPool::parallelFor(std::size_t count, std::size_t grain, const Task& task)
+{
+  grain = std::max<std::size_t>(grain, 1);
+  if (threads_.size() == 0 || count <= grain)
+  {
+    task(0, count);
+    return;
+  }
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    task_ = &task;
+    count_ = count;
+    grain_ = grain;
+    next_ = 0;
+    busy_ = threads_.size();
+    ++generation_;
+  }
+  start_condition_.notify_all();
+  runChunks();
+  // barrier: wait for the workers to finish their chunks
+  boost::mutex::scoped_lock lock(mutex_);
+  while (busy_ > 0)
+  {
+    done_condition_.wait(lock);
+  }
+  task_ = NULL;
+}
+
+void WorkerPool::work()
+{
+  unsigned int generation = 0;
+  while (true)
+  {
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      while (!shutdown_ && generation == generation_)
+      {
+        start_condition_.wait(lock);
+      }
+      if (shutdown_)
+      {
+        return;
+      }
+      generation = generation_;
+    }
+    runChunks();
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      if (--busy_ == 0)
+      {
+        done_condition_.notify_one();
+      }
+    }
+  }
+}
+
+void WorkerPool::runChunks()
+{
+  std::size_t begin;
+  while ((begin = next_.fetch_add(grain_)) < count_)
+  {
+    (*task_)(begin, std::min(begin + grain_, count_));
+  }
+}
+
+} // namespace gazebo
@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2013, Yujin Robot.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Yujin Robot nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <algorithm>
+#include "kobuki_gazebo_plugins/world_stepper.h"
+#include "kobuki_gazebo_plugins/gazebo_ros_kobuki.h"
+
+namespace gazebo
+{
+
+WorldStepper& WorldStepper::instance()
+{
+  static WorldStepper stepper;
+  return stepper;
+}
+
+void WorldStepper::add(GazeboRosKobuki* robot)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  robots_.push_back(robot);
+}
+
+void WorldStepper::remove(GazeboRosKobuki* robot)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  robots_.erase(std::remove(robots_.begin(), robots_.end(), robot), robots_.end());
+}
+
+GazeboRosKobuki* WorldStepper::find(const std::string& name) const
+{
+  for (std::size_t i = 0; i < robots_.size(); ++i)
+  {
+    if (robots_[i]->node_name_ == name)
+    {
+      return robots_[i];
+    }
+  }
+  return NULL;
+}
+
+WorldStepper::Result WorldStepper::step(physics::World& world, GazeboRosKobuki& robot,
+                                        const kobuki_gazebo_plugins::StepN::Request& req,
+                                        kobuki_gazebo_plugins::StepN::Response& res)
+{
+  boost::mutex::scoped_try_lock step_lock(step_mutex_);
+  if (!step_lock.owns_lock())
+  {
+    return BUSY;
+  }
+  // only once the request is accepted, so a rejected one has no effect
+  for (std::size_t i = 0; i < req.commands.size(); ++i)
+  {
+    robot.queueStampedCommand(req.commands[i]);
+  }
+  if (!advance(world, req.steps, &robot))
+  {
+    return FAILED;
+  }
+  boost::mutex::scoped_lock lock(robot.step_mutex_);
+  res = *robot.step_result_;
+  return STEPPED;
+}
+
+WorldStepper::Result WorldStepper::step(physics::World& world,
+                                        const kobuki_gazebo_plugins::StepFleet::Request& req,
+                                        kobuki_gazebo_plugins::StepFleet::Response& res)
+{
+  boost::mutex::scoped_try_lock step_lock(step_mutex_);
+  if (!step_lock.owns_lock())
+  {
+    return BUSY;
+  }
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    if (req.command_robots.size() != req.commands.size())
+    {
+      return FAILED;
+    }
+    std::vector<GazeboRosKobuki*> command_robots(req.commands.size());
+    for (std::size_t i = 0; i < req.commands.size(); ++i)
+    {
+      command_robots[i] = find(req.command_robots[i]);
+      if (!command_robots[i])
+      {
+        return FAILED;
+      }
+    }
+    for (std::size_t i = 0; i < req.commands.size(); ++i)
+    {
+      command_robots[i]->queueStampedCommand(req.commands[i]);
+    }
+  }
+  if (!advance(world, req.steps, NULL))
+  {
+    return FAILED;
+  }
+  common::Time time_now = api::simTime(world);
+  res.sim_time = ros::Time(time_now.sec, time_now.nsec);
+  // robots unregistered during the steps are left out
+  boost::mutex::scoped_lock lock(mutex_);
+  res.robots.resize(robots_.size());
+  res.odom.resize(robots_.size());
+  res.imu.resize(robots_.size());
+  res.sensors.resize(robots_.size());
+  for (std::size_t i = 0; i < robots_.size(); ++i)
+  {
+    GazeboRosKobuki& robot = *robots_[i];
+    boost::mutex::scoped_lock result_lock(robot.step_mutex_);
+    res.robots[i] = robot.node_name_;
+    res.odom[i] = robot.step_result_->odom;
+    res.imu[i] = robot.step_result_->imu;
+    res.sensors[i] = robot.step_result_->sensors;
+  }
+  return STEPPED;
+}
+
+/*
+ * Only this (the service) thread sets the step counts, the robots' updates count them down
+ */
+bool WorldStepper::advance(physics::World& world, unsigned int steps, GazeboRosKobuki* robot)
+{
+  if (steps == 0)
+  {
+    return false;
+  }
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    for (std::size_t i = 0; i < robots_.size(); ++i)
+    {
+      if (!robot || (robots_[i] == robot))
+      {
+        robots_[i]->step_updates_remaining_ = steps;
+      }
+    }
+  }
+  // blocks until the world has advanced
+  world.Step(steps);
+  bool done = true;
+  boost::mutex::scoped_lock lock(mutex_);
+  for (std::size_t i = 0; i < robots_.size(); ++i)
+  {
+    if (robots_[i]->step_updates_remaining_ != 0)
+    {
+      // the world stopped before finishing the steps
+      robots_[i]->step_updates_remaining_ = 0;
+      done = false;
+    }
+  }
+  return done;
+}
+
+} // namespace gazebo